@@ -0,0 +1,258 @@
+#include "Benchmark.h"
+#include "Scaler.h"
+#include "Observation.h"
+#include "ShiftRegister.h"
+#include <string.h>
+#include <chrono>
+#include <memory>
+#include <stdio.h>
+
+Benchmark::Benchmark(const string& filter, const MachineOptions& options)
+    : filter(filter), options(options)
+{
+    this->options.headless = true;
+    this->options.record_file.clear();
+}
+
+Benchmark::~Benchmark()
+{
+}
+
+int Benchmark::run(){
+    printf("%-32s %12s %12s\n", "case", "us/iter", "iter/s");
+    scaler_cases();
+    observation_cases();
+    shifter_cases();
+    cpu_cases();
+    emulation_cases();
+    return 0;
+}
+
+void Benchmark::time_case(const string& name, int iterations, const function<void()>& body){
+    if(!selected(name)) return;
+
+    body(); // warm up caches
+    auto start = chrono::steady_clock::now();
+    for(int i=0; i<iterations; i++){
+        body();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    printf("%-32s %12.2f %12.0f\n", name.c_str(), seconds*1e6/iterations, iterations/seconds);
+    fflush(stdout);
+}
+
+void Benchmark::scaler_cases(){
+    // a fixed pseudo random picture, so every run converts the same pixels
+    auto vram = make_unique<uint8_t[]>(Scaler::vram_size);
+    uint32_t seed = 12345;
+    for(int i=0; i<Scaler::vram_size; i++){
+        seed = seed*1103515245 + 12345;
+        vram[i] = (seed >> 16) & 0xFF;
+    }
+
+    struct { const char* name; int scale; bool scanlines; bool overlay; } cases[] = {
+        {"scaler/1x",                   1, false, false},
+        {"scaler/2x",                   2, false, false},
+        {"scaler/3x",                   3, false, false},
+        {"scaler/4x",                   4, false, false},
+        {"scaler/3x+scanlines",         3, true,  false},
+        {"scaler/3x+overlay",           3, false, true },
+        {"scaler/3x+scanlines+overlay", 3, true,  true },
+    };
+    for(auto& c : cases){
+        Scaler scaler(c.scale, c.scanlines, c.overlay);
+        auto out = make_unique<uint32_t[]>(scaler.width()*scaler.height());
+        time_case(c.name, 500, [&](){
+            scaler.render(vram.get(), out.get(), scaler.width());
+        });
+    }
+}
+
+void Benchmark::observation_cases(){
+    auto vram = make_unique<uint8_t[]>(VramView::size);
+    uint32_t seed = 12345;
+    for(size_t i=0; i<VramView::size; i++){
+        seed = seed*1103515245 + 12345;
+        vram[i] = (seed >> 16) & 0xFF;
+    }
+    VramView view = {vram.get()};
+
+    // the conversion of the window for comparison, 4 bytes per pixel
+    Scaler scaler(1, false, false);
+    auto rgb = make_unique<uint32_t[]>(Observation::width*Observation::height);
+    time_case("observation/rgb32", 2000, [&](){
+        scaler.render(view.data, rgb.get(), Observation::width);
+    });
+
+    auto gray = make_unique<uint8_t[]>(Observation::width*Observation::height);
+    auto reference = make_unique<uint8_t[]>(Observation::width*Observation::height);
+    time_case("observation/gray", 2000, [&](){
+        Observation::grayscale(view, gray.get());
+    });
+    time_case("observation/gray-scalar", 2000, [&](){
+        Observation::grayscale_scalar(view, reference.get());
+    });
+    if(selected("observation/gray") && memcmp(gray.get(), reference.get(), Observation::width*Observation::height) != 0){
+        printf("observation/gray differs from observation/gray-scalar\n");
+    }
+
+    auto small = make_unique<uint8_t[]>(Observation::small_size);
+    auto small_reference = make_unique<uint8_t[]>(Observation::small_size);
+    time_case("observation/downsample", 2000, [&](){
+        Observation::downsample(view, small.get());
+    });
+    time_case("observation/downsample-scalar", 2000, [&](){
+        Observation::downsample_scalar(view, small_reference.get());
+    });
+    if(selected("observation/downsample") && memcmp(small.get(), small_reference.get(), Observation::small_size) != 0){
+        printf("observation/downsample differs from observation/downsample-scalar\n");
+    }
+
+    // what an agent does every frame: add the frame and take the stack of the last 4
+    Observation history(4);
+    auto stack = make_unique<uint8_t[]>(history.depth() * Observation::small_size);
+    time_case("observation/history-4", 2000, [&](){
+        history.push(view);
+        history.stacked(stack.get());
+    });
+}
+
+void Benchmark::shifter_cases(){
+    // a sprite row at every shift amount, one iteration is 1000 rows of 16 bytes
+    uint8_t sprite[16];
+    uint8_t shifted[16];
+    for(int i=0; i<16; i++){
+        sprite[i] = i * 37;
+    }
+    ShiftRegister shifter;
+    volatile uint8_t sink = 0;
+    time_case("shifter/push-read", 2000, [&](){
+        for(int row=0; row<1000; row++){
+            shifter.set_amount(row);
+            for(int i=0; i<16; i++){
+                shifter.push(sprite[i]);
+                shifted[i] = shifter.result();
+            }
+            sink = sink + shifted[row & 15];
+        }
+    });
+    time_case("shifter/batch", 2000, [&](){
+        for(int row=0; row<1000; row++){
+            shifter.set_amount(row);
+            shifter.push_and_read(sprite, shifted, 16);
+            sink = sink + shifted[row & 15];
+        }
+    });
+}
+
+void Benchmark::cpu_cases(){
+    // a loop through the ALU instructions and PUSH/POP PSW, runs without a ROM
+    const uint8_t alu_loop[] = {
+        0x31, 0x00, 0xF0, // LXI SP,$F000
+        0x06, 0x00,       // MVI B,0
+        0x80, 0x8F, 0x91, // ADD B, ADC A, SUB C
+        0xA2, 0xB3, 0xAC, // ANA D, ORA E, XRA H
+        0xBD, 0x3C, 0x0D, // CMP L, INR A, DCR C
+        0x27,             // DAA
+        0xF5, 0xF1,       // PUSH PSW, POP PSW
+        0xFE, 0x10,       // CPI $10
+        0x05,             // DCR B
+        0xC2, 0x05, 0x00, // JNZ $0005
+        0xC3, 0x03, 0x00, // JMP $0003
+    };
+    Emulator emu(0x10000, 0);
+    emu.load_program(alu_loop, sizeof(alu_loop));
+    // one iteration is 10000 instructions
+    time_case("cpu/alu-10k", 1000, [&](){
+        for(int i=0; i<10000; i++){
+            emu.execute_next_instruction();
+        }
+    });
+}
+
+unique_ptr<Machine> Benchmark::make_machine(const string& name, uint64_t frames, const MachineOptions& options){
+    unique_ptr<Machine> machine;
+    try {
+        machine = make_unique<Machine>(options);
+    } catch(std::exception& e){
+        printf("%-32s skipped: %s\n", name.c_str(), e.what());
+        return nullptr;
+    }
+    if(this->options.replay_file.empty()){
+        machine->replay(InputLog::demo(machine->current_input(), frames));
+    }
+    return machine;
+}
+
+void Benchmark::emulation_cases(){
+    // one minute of game play, one iteration is one frame
+    const int frames = 3600;
+    if(selected("emulation/frame")){
+        auto machine = make_machine("emulation/frame", frames+1, this->options);
+        if(machine){
+            time_case("emulation/frame", frames, [&](){
+                machine->run_frames(1);
+            });
+            machine->print_statistics();
+        }
+    }
+    // without superinstructions and OUT 4; IN 3 fusion, to measure them
+    if(selected("emulation/unfused-frame")){
+        MachineOptions options = this->options;
+        options.fusion = false;
+        auto machine = make_machine("emulation/unfused-frame", frames+1, options);
+        if(machine){
+            time_case("emulation/unfused-frame", frames, [&](){
+                machine->run_frames(1);
+            });
+        }
+    }
+    // every round of the idle loops run, to measure how much skipping them saves
+    if(selected("emulation/no-idle-skip-frame")){
+        MachineOptions options = this->options;
+        options.idle_skip = false;
+        auto machine = make_machine("emulation/no-idle-skip-frame", frames+1, options);
+        if(machine){
+            time_case("emulation/no-idle-skip-frame", frames, [&](){
+                machine->run_frames(1);
+            });
+        }
+    }
+    // the snapshot that run-ahead and netplay take and restore every frame
+    if(selected("state/save+load")){
+        auto machine = make_machine("state/save+load", frames+1, this->options);
+        if(machine){
+            machine->run_frames(600); // past the boot
+            MachineState state;
+            time_case("state/save+load", 100000, [&](){
+                machine->save_state(state);
+                machine->load_state(state);
+            });
+        }
+    }
+    // one shown frame with run-ahead is 1+N emulated frames, a save and a load.
+    // At 60 frames per second it has to take well under 16667 us
+    for(int ahead=1; ahead<=4; ahead++){
+        string name = "emulation/run-ahead-" + to_string(ahead);
+        if(!selected(name)) continue;
+        MachineOptions options = this->options;
+        options.run_ahead = ahead;
+        auto machine = make_machine(name, frames+ahead+1, options);
+        if(machine){
+            time_case(name, frames, [&](){
+                machine->run_ahead_frame();
+            });
+        }
+    }
+    // the same session with the native ROM routines
+    if(selected("emulation/hle-frame")){
+        MachineOptions options = this->options;
+        options.hle = true;
+        auto machine = make_machine("emulation/hle-frame", frames+1, options);
+        if(machine){
+            time_case("emulation/hle-frame", frames, [&](){
+                machine->run_frames(1);
+            });
+        }
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "Machine.h"
+#include <string>
+#include <functional>
+
+using namespace std;
+
+// Micro benchmarks of the hot paths, started with --bench.
+// Every case is run for a fixed number of iterations and the time per iteration is printed.
+// The emulation cases need the ROM and play back --replay, or a scripted session without it.
+
+class Benchmark
+{
+    public:
+        Benchmark(const string& filter = "", const MachineOptions& options = MachineOptions());
+        virtual ~Benchmark();
+        int run();
+
+    private:
+        string filter; // only run cases whose name contains this
+        MachineOptions options;
+
+        bool selected(const string& name) const { return name.find(this->filter) != string::npos; }
+        void time_case(const string& name, int iterations, const function<void()>& body);
+        unique_ptr<Machine> make_machine(const string& name, uint64_t frames, const MachineOptions& options);
+        void scaler_cases();
+        void observation_cases();
+        void shifter_cases();
+        void cpu_cases();
+        void emulation_cases();
+};
+
+#endif // BENCHMARK_H
@@ -0,0 +1,95 @@
+#include "BoardProfile.h"
+#include <stdexcept>
+
+static vector<BoardProfile> make_profiles(){
+    vector<BoardProfile> profiles;
+
+    BoardProfile invaders;
+    invaders.name = "invaders";
+    invaders.description = "Space Invaders (Midway), ROM in four files";
+    // standard file endings are "little endian": .h is loaded first
+    invaders.roms = {
+        {"invaders.h", 0x0000, 0x0800, 0x734f5ad8, "ff6200af4c9110d8181249cbcef1a8a40fa40b7f"},
+        {"invaders.g", 0x0800, 0x0800, 0x6bfaca4a, "16f48649b531bdef8c2d1446c429b5f414524350"},
+        {"invaders.f", 0x1000, 0x0800, 0x0ccead96, "537aef03468f63c5b9e11dd61e253f7ae17d9743"},
+        {"invaders.e", 0x1800, 0x0800, 0x14e538b0, "1d6ca0c99f9df71e2990b610deb9d7da0125e2d8"},
+    };
+    // the boot code copies 1B00-1BFF to 2000-20FF in the first frame, the high score (BCD) included
+    invaders.nvram = {
+        {"hiscore", 0x20F4, 2},
+        {"credits", 0x20EB, 1},
+    };
+    invaders.nvram_restore_frame = 10;
+    profiles.push_back(invaders);
+
+    BoardProfile invaders_bin = invaders;
+    invaders_bin.name = "invaders-bin";
+    invaders_bin.description = "Space Invaders (Midway), ROM in one file";
+    // the four files one after the other, there is no checksum of the whole file
+    invaders_bin.roms = {
+        {"invaders.bin", 0x0000, 0x2000, 0, "", invaders.roms},
+    };
+    profiles.push_back(invaders_bin);
+
+    for(auto& profile : profiles){
+        profile.validate();
+    }
+    return profiles;
+}
+
+const vector<BoardProfile>& BoardProfile::all(){
+    static const vector<BoardProfile> profiles = make_profiles();
+    return profiles;
+}
+
+const BoardProfile& BoardProfile::find(const string& name){
+    for(auto& profile : all()){
+        if(profile.name == name) return profile;
+    }
+    throw std::runtime_error("Unknown board profile: " + name);
+}
+
+void BoardProfile::validate() const{
+    if(this->roms.empty()){
+        throw std::runtime_error("Board profile " + this->name + " has no ROM files");
+    }
+    for(size_t i=0; i<this->roms.size(); i++){
+        const RomFile& rom = this->roms[i];
+        // the ROM has to fit into the 8K below the RAM
+        if(rom.size == 0 || rom.offset + rom.size > 0x2000){
+            throw std::runtime_error("Board profile " + this->name + ": " + rom.filename + " does not fit into ROM");
+        }
+        for(size_t j=0; j<i; j++){
+            const RomFile& other = this->roms[j];
+            if(rom.offset < other.offset + other.size && other.offset < rom.offset + rom.size){
+                throw std::runtime_error("Board profile " + this->name + ": " + rom.filename + " overlaps " + other.filename);
+            }
+        }
+        for(const RomFile& slice : rom.slices){
+            if(slice.offset < rom.offset || slice.offset + slice.size > rom.offset + rom.size){
+                throw std::runtime_error("Board profile " + this->name + ": " + slice.filename + " is not inside " + rom.filename);
+            }
+        }
+    }
+    for(const NvramRange& range : this->nvram){
+        if(range.size == 0 || range.adress < 0x2000 || range.adress + range.size > 0x4000){
+            throw std::runtime_error("Board profile " + this->name + ": NVRAM " + range.name + " is not in RAM");
+        }
+    }
+    if(!this->nvram.empty() && this->nvram_restore_frame == 0){
+        throw std::runtime_error("Board profile " + this->name + ": NVRAM has to be restored after the first frame");
+    }
+    const PortMap& p = this->ports;
+    uint8_t in_ports[]  = {p.input0, p.input1, p.input2, p.shift_result};
+    uint8_t out_ports[] = {p.shift_amount, p.shift_data, p.sound1, p.sound2, p.watchdog};
+    for(int i=0; i<4; i++){
+        for(int j=0; j<i; j++){
+            if(in_ports[i] == in_ports[j]) throw std::runtime_error("Board profile " + this->name + ": IN port used twice");
+        }
+    }
+    for(int i=0; i<5; i++){
+        for(int j=0; j<i; j++){
+            if(out_ports[i] == out_ports[j]) throw std::runtime_error("Board profile " + this->name + ": OUT port used twice");
+        }
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef BOARDPROFILE_H
+#define BOARDPROFILE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// A board profile describes one game on the Space Invaders hardware:
+// which ROM files go where, how the I/O ports are wired and the default DIP switches.
+
+struct RomFile {
+    string filename;
+    uint16_t offset; // where the file is loaded in memory
+    uint16_t size;   // expected size of the file in bytes
+    uint32_t crc32;  // expected CRC32 of the file, 0 = unknown, not checked
+    string sha1;     // expected SHA1 as hex string, empty = unknown, not checked
+    vector<RomFile> slices; // known files this one is made of, each checked on its own (offsets in memory)
+};
+
+// port numbers of the devices (IN and OUT have separate port spaces)
+struct PortMap {
+    uint8_t input0 = 0;       // IN:  unused inputs, always 0x0F on Space Invaders
+    uint8_t input1 = 1;       // IN:  coin, start buttons and player 1 controls
+    uint8_t input2 = 2;       // IN:  DIP switches and player 2 controls
+    uint8_t shift_result = 3; // IN:  result of the shift register
+    uint8_t shift_amount = 2; // OUT: how far the shift register shifts
+    uint8_t shift_data = 4;   // OUT: push a byte into the shift register
+    uint8_t sound1 = 3;       // OUT: sounds (unimplemented)
+    uint8_t sound2 = 5;       // OUT: more sounds (unimplemented)
+    uint8_t watchdog = 6;     // OUT: watchdog (unimplemented)
+};
+
+// RAM that the real cabinet would keep while switched off, saved with --nvram
+struct NvramRange {
+    string name;
+    uint16_t adress;
+    uint16_t size;
+};
+
+struct BoardProfile {
+    string name;
+    string description;
+    vector<RomFile> roms;
+    PortMap ports;
+
+    // power on value of the input ports, port 2 holds the DIP switches
+    uint8_t port0 = 0x0F; // first four bits always 1, then fire, left, right
+    uint8_t port1 = 0x09; // player 1 controls, 1P/2P START, CREDIT, bit 3 is always 1
+    uint8_t port2 = 0x03; // player 2 controls, difficulty dip switches, lives: 3+2*(bit1)+(bit0)
+    uint8_t dip_mask = 0x8B; // bits of port 2 that are DIP switches
+
+    bool overlay = true; // the cabinet had coloured strips on the screen
+
+    vector<NvramRange> nvram;
+    uint64_t nvram_restore_frame = 0; // the saved RAM is written back after this frame, when the boot code is done with it
+
+    static const vector<BoardProfile>& all();
+    // throws if there is no profile with that name
+    static const BoardProfile& find(const string& name);
+    // throws if the profile itself is inconsistent, e.g. overlapping ROM files
+    void validate() const;
+};
+
+#endif // BOARDPROFILE_H
@@ -0,0 +1,89 @@
+#include "Checksum.h"
+#include <stdio.h>
+
+// table for the reflected polynomial 0xEDB88320, one entry per byte value
+struct CrcTable {
+    uint32_t entry[256];
+    CrcTable(){
+        for(uint32_t n=0; n<256; n++){
+            uint32_t c = n;
+            for(int k=0; k<8; k++){
+                c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : (c >> 1);
+            }
+            entry[n] = c;
+        }
+    }
+};
+static const CrcTable crc_table;
+
+uint32_t crc32(const uint8_t* data, size_t size){
+    uint32_t c = 0xFFFFFFFF;
+    for(size_t i=0; i<size; i++){
+        c = crc_table.entry[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+    }
+    return c ^ 0xFFFFFFFF;
+}
+
+static inline uint32_t rotl(uint32_t x, int n){
+    return (x << n) | (x >> (32-n));
+}
+
+// process one 64 byte block
+static void sha1_block(uint32_t h[5], const uint8_t* block){
+    uint32_t w[80];
+    for(int i=0; i<16; i++){
+        w[i] = (block[4*i] << 24) | (block[4*i+1] << 16) | (block[4*i+2] << 8) | block[4*i+3];
+    }
+    for(int i=16; i<80; i++){
+        w[i] = rotl(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+    }
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for(int i=0; i<80; i++){
+        uint32_t f, k;
+        if(i < 20){
+            f = (b & c) | (~b & d);          k = 0x5A827999;
+        } else if(i < 40){
+            f = b ^ c ^ d;                   k = 0x6ED9EBA1;
+        } else if(i < 60){
+            f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;                   k = 0xCA62C1D6;
+        }
+        uint32_t temp = rotl(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rotl(b, 30);
+        b = a;
+        a = temp;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+}
+
+std::string sha1(const uint8_t* data, size_t size){
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    size_t full = size - size % 64;
+    for(size_t i=0; i<full; i+=64){
+        sha1_block(h, data+i);
+    }
+    // padding: a one bit, zeros and the length in bits as 64 bit big endian number
+    uint8_t tail[128] = {0};
+    size_t rest = size - full;
+    for(size_t i=0; i<rest; i++){
+        tail[i] = data[full+i];
+    }
+    tail[rest] = 0x80;
+    size_t tail_size = (rest < 56) ? 64 : 128;
+    uint64_t bits = (uint64_t) size * 8;
+    for(int i=0; i<8; i++){
+        tail[tail_size-1-i] = (bits >> (8*i)) & 0xFF;
+    }
+    for(size_t i=0; i<tail_size; i+=64){
+        sha1_block(h, tail+i);
+    }
+
+    char hex[41];
+    for(int i=0; i<5; i++){
+        snprintf(hex + 8*i, 9, "%08x", h[i]);
+    }
+    return std::string(hex, 40);
+}
@@ -0,0 +1,16 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+// Checksums used to verify ROM files
+
+// CRC32 as used by zip and MAME
+uint32_t crc32(const uint8_t* data, size_t size);
+
+// SHA1 as a lowercase hex string (40 characters)
+std::string sha1(const uint8_t* data, size_t size);
+
+#endif // CHECKSUM_H
@@ -0,0 +1,245 @@
+#include "Debugger.h"
+
+#ifdef ENABLE_DEBUGGER
+
+#include "Disassembler.h"
+#include <iostream>
+#include <sstream>
+#include <stdio.h>
+#include <string.h>
+
+// accepts 1A32, $1A32 and 0x1A32
+static unsigned long parse_number(const string& text){
+    string digits = (!text.empty() && text[0] == '$') ? text.substr(1) : text;
+    size_t end = 0;
+    unsigned long value = stoul(digits, &end, 16);
+    if(end != digits.size()){
+        throw std::invalid_argument(text);
+    }
+    return value;
+}
+
+static void print_help(){
+    printf("  c              continue\n");
+    printf("  s [N]          step N instructions (default 1)\n");
+    printf("  n              step over CALL and RST\n");
+    printf("  b [ADDR]       set a breakpoint at ADDR or list the breakpoints\n");
+    printf("  d ADDR         delete the breakpoint at ADDR\n");
+    printf("  w ADDR [r|w|rw] stop when ADDR is read and/or written (default w)\n");
+    printf("  uw ADDR        delete the watchpoint at ADDR\n");
+    printf("  r              show registers and flags\n");
+    printf("  l [ADDR] [N]   disassemble N instructions (default from PC)\n");
+    printf("  x ADDR [N]     show N bytes of memory\n");
+    printf("  q              quit the emulator\n");
+    printf("  an empty line repeats the last command, adresses are hex\n");
+}
+
+Debugger::Debugger(Emulator& emu)
+    : emu(emu)
+{
+    memset(this->breakpoints, 0, sizeof(this->breakpoints));
+    this->watchpoints = make_unique<uint8_t[]>(0x10000);
+    memset(this->watchpoints.get(), 0, 0x10000);
+}
+
+Debugger::~Debugger()
+{
+    this->emu.watchpoints = nullptr;
+}
+
+void Debugger::update_armed(){
+    this->armed = this->breakpoint_count > 0 || this->watchpoint_count > 0 || this->break_requested ||
+                  this->steps_left > 0 || this->step_over_adress >= 0;
+}
+
+bool Debugger::check(){
+    bool stop = false;
+    this->stop_watch = -1;
+    if(this->emu.watch_hit >= 0){
+        char text[32];
+        Disassembler::disassemble(this->emu, this->last_pc, text, sizeof(text));
+        printf("watchpoint: %s $%04x at %04x %s\n", this->emu.watch_hit_write ? "write to" : "read of",
+            this->emu.watch_hit, this->last_pc, text);
+        this->stop_watch = this->emu.watch_hit;
+        this->stop_watch_write = this->emu.watch_hit_write;
+        this->emu.watch_hit = -1;
+        stop = true;
+    }
+    if(has_breakpoint(this->emu.pc)){
+        printf("breakpoint at %04x\n", this->emu.pc);
+        stop = true;
+    }
+    // the sp check keeps recursive calls from stopping too early
+    if(this->step_over_adress == this->emu.pc && this->emu.sp >= this->step_over_sp){
+        stop = true;
+    }
+    if(this->steps_left > 0 && --this->steps_left == 0){
+        stop = true;
+    }
+    stop = stop || this->break_requested;
+    this->last_pc = this->emu.pc;
+
+    if(stop){
+        // whatever stopped the emulation ends the current step
+        this->break_requested = false;
+        this->steps_left = 0;
+        this->step_over_adress = -1;
+        update_armed();
+    }
+    return stop;
+}
+
+void Debugger::request_break(){
+    this->break_requested = true;
+    update_armed();
+}
+
+void Debugger::set_breakpoint(uint16_t adress, bool enabled){
+    if(has_breakpoint(adress) == enabled) return;
+    this->breakpoints[adress >> 6] ^= (uint64_t) 1 << (adress & 63);
+    this->breakpoint_count += enabled ? 1 : -1;
+    update_armed();
+}
+
+void Debugger::set_watchpoint(uint16_t adress, uint8_t kind){
+    adress &= this->emu.RAM_size-1; // the CPU reports mirrored adresses
+    if(this->watchpoints[adress] != 0) this->watchpoint_count--;
+    if(kind != 0) this->watchpoint_count++;
+    this->watchpoints[adress] = kind;
+    // without watchpoints the memory accesses only test a null pointer
+    this->emu.watchpoints = this->watchpoint_count > 0 ? this->watchpoints.get() : nullptr;
+    update_armed();
+}
+
+void Debugger::step(uint64_t instructions){
+    this->steps_left = instructions;
+    update_armed();
+}
+
+void Debugger::step_over(){
+    uint8_t opcode = this->emu.memory[this->emu.pc & (this->emu.RAM_size-1)];
+    if(!Disassembler::is_call(opcode)){
+        step(1);
+        return;
+    }
+    this->step_over_adress = (this->emu.pc + Disassembler::length(opcode)) & 0xFFFF;
+    this->step_over_sp = this->emu.sp;
+    update_armed();
+}
+
+void Debugger::resume(){
+    this->steps_left = 0;
+    this->step_over_adress = -1;
+    this->break_requested = false;
+    update_armed();
+}
+
+void Debugger::print_registers(){
+    uint8_t f = this->emu.flags;
+    printf("PC %04X SP %04X A %02X B %02X C %02X D %02X E %02X H %02X L %02X flags %c%c%c%c%c%s cycles %llu\n",
+        this->emu.pc, this->emu.sp, this->emu.a, this->emu.b, this->emu.c, this->emu.d, this->emu.e,
+        this->emu.h, this->emu.l,
+        (f & FLAG_S) ? 's' : '.', (f & FLAG_Z) ? 'z' : '.', (f & FLAG_AC) ? 'a' : '.',
+        (f & FLAG_P) ? 'p' : '.', (f & FLAG_CY) ? 'c' : '.',
+        this->emu.interrupt_enabled ? " EI" : " DI", (unsigned long long) this->emu.cycles);
+}
+
+void Debugger::print_disassembly(uint16_t adress, int count){
+    for(int i=0; i<count; i++){
+        char text[32];
+        const string* label = this->symbols ? this->symbols->find(adress) : nullptr;
+        if(label){
+            printf("%s:\n", label->c_str());
+        }
+        int length = Disassembler::disassemble(this->emu, adress, text, sizeof(text));
+        char bytes[12] = "";
+        for(int j=0; j<length; j++){
+            snprintf(bytes + 3*j, sizeof(bytes) - 3*j, "%02x ", this->emu.memory[(adress+j) & (this->emu.RAM_size-1)]);
+        }
+        printf("%c%c %04x  %-9s %s\n", adress == this->emu.pc ? '>' : ' ', has_breakpoint(adress) ? '*' : ' ',
+            adress, bytes, text);
+        adress += length;
+    }
+}
+
+void Debugger::print_memory(uint16_t adress, int count){
+    for(int i=0; i<count; i+=16){
+        printf("%04x ", (adress+i) & 0xFFFF);
+        for(int j=i; j<i+16 && j<count; j++){
+            printf(" %02x", this->emu.memory[(adress+j) & (this->emu.RAM_size-1)]);
+        }
+        printf("\n");
+    }
+}
+
+bool Debugger::prompt(){
+    print_registers();
+    print_disassembly(this->emu.pc, 1);
+    string line;
+    while(true){
+        printf("(debug) ");
+        fflush(stdout);
+        if(!getline(cin, line)) return false; // end of input quits
+        if(line.empty()){
+            line = this->last_command;
+        } else {
+            this->last_command = line;
+        }
+        bool quit = false;
+        bool resumed = false;
+        try {
+            resumed = execute(line, quit);
+        } catch(const std::logic_error& e){ // invalid_argument and out_of_range of stoul
+            printf("invalid argument, h shows the commands\n");
+        }
+        if(quit) return false;
+        if(resumed) return true;
+    }
+}
+
+// returns true if the emulation continues
+bool Debugger::execute(const string& line, bool& quit){
+    istringstream in(line);
+    string command, arg1, arg2;
+    in >> command >> arg1 >> arg2;
+
+    if(command == "c"){
+        resume();
+        return true;
+    } else if(command == "s"){
+        step(arg1.empty() ? 1 : stoull(arg1));
+        return true;
+    } else if(command == "n"){
+        step_over();
+        return true;
+    } else if(command == "b"){
+        if(!arg1.empty()){
+            set_breakpoint(parse_number(arg1), true);
+        }
+        for(int adress=0; adress<0x10000; adress++){
+            if(has_breakpoint(adress)) print_disassembly(adress, 1);
+        }
+    } else if(command == "d"){
+        set_breakpoint(parse_number(arg1), false);
+    } else if(command == "w"){
+        uint8_t kind = WATCH_WRITE;
+        if(arg2 == "r") kind = WATCH_READ;
+        if(arg2 == "rw") kind = WATCH_READ | WATCH_WRITE;
+        set_watchpoint(parse_number(arg1), kind);
+    } else if(command == "uw"){
+        set_watchpoint(parse_number(arg1), 0);
+    } else if(command == "r"){
+        print_registers();
+    } else if(command == "l"){
+        print_disassembly(arg1.empty() ? this->emu.pc : parse_number(arg1), arg2.empty() ? 10 : stoi(arg2));
+    } else if(command == "x"){
+        print_memory(parse_number(arg1), arg2.empty() ? 64 : stoi(arg2));
+    } else if(command == "q"){
+        quit = true;
+    } else {
+        print_help();
+    }
+    return false;
+}
+
+#endif // ENABLE_DEBUGGER
@@ -0,0 +1,76 @@
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#ifdef ENABLE_DEBUGGER
+
+#include "Emulator.h"
+#include "SymbolTable.h"
+#include <stdint.h>
+#include <string>
+#include <memory>
+
+using namespace std;
+
+// This class stops the emulation at breakpoints and watchpoints and lets the user
+// step through the program and inspect the CPU from a command prompt on stdin.
+// Breakpoints are a bitmap over the 64K adress space, so the machine only has to test
+// `armed` before every instruction while no breakpoint, watchpoint or step is set.
+// It is only built with ENABLE_DEBUGGER (make CONFIG=debug or DEBUGGER=1).
+
+class Debugger
+{
+    public:
+        Debugger(Emulator& emu);
+        virtual ~Debugger();
+
+        bool armed = false; // a breakpoint, watchpoint or step is set, check() has to run
+        int stop_watch = -1;         // adress of the watchpoint of the last stop, -1 = not a watchpoint
+        bool stop_watch_write = false;
+
+        // called before every instruction while armed, true if the emulation has to stop
+        bool check();
+        // command prompt, returns false if the user wants to quit
+        bool prompt();
+        // stop before the next instruction
+        void request_break();
+
+        void set_breakpoint(uint16_t adress, bool enabled);
+        bool has_breakpoint(uint16_t adress) const {
+            return (this->breakpoints[adress >> 6] >> (adress & 63)) & 1;
+        }
+        void set_watchpoint(uint16_t adress, uint8_t kind); // WATCH_READ | WATCH_WRITE, 0 removes it
+        uint8_t watchpoint(uint16_t adress) const { return this->watchpoints[adress & (this->emu.RAM_size-1)]; }
+        void step(uint64_t instructions);
+        void step_over();
+        void resume(); // continue until the next breakpoint or watchpoint
+
+        void set_symbols(const SymbolTable* symbols) { this->symbols = symbols; }
+
+        void print_registers();
+        void print_disassembly(uint16_t adress, int count);
+        void print_memory(uint16_t adress, int count);
+
+    private:
+        Emulator& emu;
+        const SymbolTable* symbols = nullptr; // labels in the disassembly
+
+        uint64_t breakpoints[0x10000/64];
+        int breakpoint_count = 0;
+        unique_ptr<uint8_t[]> watchpoints; // WATCH_* bits of every adress
+        int watchpoint_count = 0;
+
+        bool break_requested = false;
+        uint64_t steps_left = 0;     // instructions to single-step before stopping
+        int step_over_adress = -1;   // stop when returning here from a call, -1 = none
+        uint16_t step_over_sp = 0;
+        uint16_t last_pc = 0;        // adress of the instruction that hit a watchpoint
+
+        string last_command;
+
+        void update_armed();
+        bool execute(const string& line, bool& quit);
+};
+
+#endif // ENABLE_DEBUGGER
+
+#endif // DEBUGGER_H
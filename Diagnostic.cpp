@@ -0,0 +1,194 @@
+#include "Diagnostic.h"
+#include <thread>
+#include <string.h>
+#include <stdio.h>
+#include <stdexcept>
+
+Diagnostic::Diagnostic(const vector<string>& programs, const string& reference, const string& candidate)
+    : programs(programs), reference(reference), candidate(candidate), failed(false)
+{
+    if(engines().count(reference) == 0){
+        throw std::runtime_error("Unknown dispatch engine: " + reference);
+    }
+    if(!candidate.empty() && engines().count(candidate) == 0){
+        throw std::runtime_error("Unknown dispatch engine: " + candidate);
+    }
+}
+
+Diagnostic::~Diagnostic()
+{
+}
+
+const map<string, function<void(Emulator&)>>& Diagnostic::engines(){
+    static const map<string, function<void(Emulator&)>> engines = {
+        {"switch", [](Emulator&){}}, // the plain interpreter
+        {"fused", [](Emulator& emu){     // with superinstructions, there are no interrupts to wait for
+            emu.enable_superinstructions();
+            emu.fuse_limit = ~(uint64_t) 0;
+        }},
+    };
+    return engines;
+}
+
+int Diagnostic::run(){
+    // a small worker pool, one program per core at a time
+    atomic<size_t> next(0);
+    atomic<int> passed(0);
+    auto worker = [&](){
+        size_t i;
+        while(!this->failed && (i = next++) < this->programs.size()){
+            if(run_program(this->programs[i])){
+                passed++;
+            } else {
+                this->failed = true; // stop the other programs
+            }
+        }
+    };
+    unsigned int cores = thread::hardware_concurrency();
+    size_t count = min<size_t>(this->programs.size(), cores ? cores : 1);
+    vector<thread> threads;
+    for(size_t i=0; i<count; i++){
+        threads.emplace_back(worker);
+    }
+    for(auto& t : threads){
+        t.join();
+    }
+
+    printf("%d of %zu diagnostic programs passed\n", passed.load(), this->programs.size());
+    return this->failed ? 1 : 0;
+}
+
+void Diagnostic::load(Emulator& emu, const string& program){
+    emu.load_program_from_file(program, 0x0100);
+    emu.memory[0x0005] = 0xC9; // BDOS: RET, the call itself is handled in step
+    emu.memory[0x0006] = 0x00; // top of the program memory, used to set up the stack
+    emu.memory[0x0007] = 0xF0;
+    emu.pc = 0x0100;
+}
+
+bool Diagnostic::step(Emulator& emu, string* output){
+    if(emu.pc == 0x0005){
+        // BDOS call, the function number is in C
+        string text;
+        if(emu.c == 9){ // print string at DE until '$'
+            uint16_t adress = (emu.d << 8) | emu.e;
+            while(emu.memory[adress & (emu.RAM_size-1)] != '$'){
+                // a broken program would print the memory around forever
+                if(text.size() == emu.RAM_size){
+                    throw std::runtime_error("BDOS function 9 called with a string without '$'");
+                }
+                text += (char) emu.memory[adress++ & (emu.RAM_size-1)];
+            }
+        } else if(emu.c == 2){ // print the character in E
+            text += (char) emu.e;
+        }
+        if(output) *output += text;
+    }
+    emu.execute_next_instruction();
+    return emu.pc != 0x0000; // a jump to 0 is the warm boot at the end of the program
+}
+
+string Diagnostic::compare(const Emulator& a, const Emulator& b, bool with_memory){
+    char text[256];
+    if(a.a != b.a || a.b != b.b || a.c != b.c || a.d != b.d || a.e != b.e || a.h != b.h || a.l != b.l ||
+       a.sp != b.sp || a.pc != b.pc || a.cycles != b.cycles || a.interrupt_enabled != b.interrupt_enabled ||
+       a.flags != b.flags){
+        snprintf(text, sizeof(text),
+            "registers differ\n"
+            "  %-8s PC %04X SP %04X A %02X B %02X C %02X D %02X E %02X H %02X L %02X flags %c%c%c%c%c cycles %llu\n"
+            "  %-8s PC %04X SP %04X A %02X B %02X C %02X D %02X E %02X H %02X L %02X flags %c%c%c%c%c cycles %llu\n",
+            this->reference.c_str(), a.pc, a.sp, a.a, a.b, a.c, a.d, a.e, a.h, a.l,
+            (a.flags & FLAG_S) ? 's' : '.', (a.flags & FLAG_Z) ? 'z' : '.', (a.flags & FLAG_AC) ? 'a' : '.',
+            (a.flags & FLAG_P) ? 'p' : '.', (a.flags & FLAG_CY) ? 'c' : '.',
+            (unsigned long long) a.cycles,
+            this->candidate.c_str(), b.pc, b.sp, b.a, b.b, b.c, b.d, b.e, b.h, b.l,
+            (b.flags & FLAG_S) ? 's' : '.', (b.flags & FLAG_Z) ? 'z' : '.', (b.flags & FLAG_AC) ? 'a' : '.',
+            (b.flags & FLAG_P) ? 'p' : '.', (b.flags & FLAG_CY) ? 'c' : '.',
+            (unsigned long long) b.cycles);
+        return text;
+    }
+    // the hashes are compared after every instruction, the memory only to find the difference
+    if((a.memory_hash != b.memory_hash || with_memory) && memcmp(a.memory.get(), b.memory.get(), a.RAM_size) != 0){
+        for(unsigned int i=0; i<a.RAM_size; i++){
+            if(a.memory[i] != b.memory[i]){
+                snprintf(text, sizeof(text), "memory differs at %04X: %02X vs %02X\n", i, a.memory[i], b.memory[i]);
+                return text;
+            }
+        }
+    }
+    return "";
+}
+
+void Diagnostic::print(const string& program, const string& text){
+    lock_guard<mutex> lock(this->print_mutex);
+    printf("[%s] %s", program.c_str(), text.c_str());
+    fflush(stdout);
+}
+
+bool Diagnostic::run_program(const string& program){
+    // CP/M programs expect 64K of RAM and no ROM
+    Emulator ref(0x10000, 0);
+    unique_ptr<Emulator> cand;
+    try {
+        load(ref, program);
+        engines().at(this->reference)(ref);
+        if(!this->candidate.empty()){
+            cand = make_unique<Emulator>(0x10000, 0);
+            load(*cand, program);
+            engines().at(this->candidate)(*cand);
+            ref.enable_hashing();
+            cand->enable_hashing();
+        }
+    } catch(std::exception& e){
+        print(program, string(e.what()) + "\n");
+        return false;
+    }
+
+    string output;
+    size_t printed = 0;
+    uint64_t steps = 0;
+    bool running = true;
+    try {
+        while(running){
+            steps++;
+            if(cand){
+                // the candidate may run several instructions at once, the reference catches up
+                step(*cand, nullptr);
+                while(running && ref.cycles < cand->cycles){
+                    running = step(ref, &output);
+                }
+                string difference = compare(ref, *cand, !running);
+                if(!difference.empty()){
+                    print(program, "engines diverged after " + to_string(steps) + " steps: " + difference);
+                    return false;
+                }
+            } else {
+                running = step(ref, &output);
+            }
+            if(ref.halted){
+                print(program, "halted at " + to_string(ref.pc) + "\n");
+                return false;
+            }
+
+            // print whole lines as they come and stop at the first error
+            size_t newline = output.find('\n', printed);
+            if(newline != string::npos || !running){
+                string text = output.substr(printed, newline == string::npos ? string::npos : newline + 1 - printed);
+                printed += text.size();
+                if(!text.empty()) print(program, text.back() == '\n' ? text : text + "\n");
+                if(text.find("ERROR") != string::npos || text.find("FAILED") != string::npos){
+                    return false;
+                }
+            }
+            if(steps % 65536 == 0 && this->failed){
+                return false; // another program failed
+            }
+        }
+    } catch(std::exception& e){
+        print(program, string(e.what()) + "\n");
+        return false;
+    }
+    if(printed < output.size()) print(program, output.substr(printed) + "\n");
+    print(program, "finished after " + to_string(ref.cycles) + " cycles\n");
+    return true;
+}
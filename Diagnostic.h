@@ -0,0 +1,46 @@
+#ifndef DIAGNOSTIC_H
+#define DIAGNOSTIC_H
+
+#include "Emulator.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <atomic>
+#include <mutex>
+
+using namespace std;
+
+// This class runs the 8080 diagnostic programs written for CP/M (cpudiag, 8080PRE, 8080EXM)
+// without a window. CP/M is emulated just enough for them: the program is loaded to 0x0100,
+// a call to the BDOS at 0x0005 prints text and a jump to 0x0000 ends the program.
+// If a second dispatch engine is given, the program runs on both in lockstep and the CPU
+// state is compared after every instruction. The programs run in parallel on all cores and
+// everything stops at the first failure.
+
+class Diagnostic
+{
+    public:
+        Diagnostic(const vector<string>& programs, const string& reference = "switch", const string& candidate = "");
+        virtual ~Diagnostic();
+        int run(); // returns 0 if all programs passed
+
+        // ways to set up the CPU core that have to behave exactly the same
+        static const map<string, function<void(Emulator&)>>& engines();
+
+    private:
+        vector<string> programs;
+        string reference;
+        string candidate;
+
+        atomic<bool> failed;
+        mutex print_mutex;
+
+        bool run_program(const string& program);
+        void load(Emulator& emu, const string& program);
+        bool step(Emulator& emu, string* output);
+        string compare(const Emulator& a, const Emulator& b, bool with_memory);
+        void print(const string& program, const string& text);
+};
+
+#endif // DIAGNOSTIC_H
@@ -0,0 +1,299 @@
+#include "Disassembler.h"
+#include <stdio.h>
+
+// mnemonic of every opcode with the operand as printf format, and the length in bytes.
+// 16 bit operands are printed with %04x, 8 bit operands with %02x.
+struct Instruction {
+    const char* format;
+    uint8_t length;
+};
+
+static const Instruction INSTRUCTIONS[256] = {
+    {"NOP",             1}, // 00
+    {"LXI  B,#$%04x",   3}, // 01
+    {"STAX B",          1}, // 02
+    {"INX  B",          1}, // 03
+    {"INR  B",          1}, // 04
+    {"DCR  B",          1}, // 05
+    {"MVI  B,#$%02x",   2}, // 06
+    {"RLC",             1}, // 07
+    {"???",             1}, // 08
+    {"DAD  B",          1}, // 09
+    {"LDAX B",          1}, // 0A
+    {"DCX  B",          1}, // 0B
+    {"INR  C",          1}, // 0C
+    {"DCR  C",          1}, // 0D
+    {"MVI  C,#$%02x",   2}, // 0E
+    {"RRC",             1}, // 0F
+    {"???",             1}, // 10
+    {"LXI  D,#$%04x",   3}, // 11
+    {"STAX D",          1}, // 12
+    {"INX  D",          1}, // 13
+    {"INR  D",          1}, // 14
+    {"DCR  D",          1}, // 15
+    {"MVI  D,#$%02x",   2}, // 16
+    {"RAL",             1}, // 17
+    {"???",             1}, // 18
+    {"DAD  D",          1}, // 19
+    {"LDAX D",          1}, // 1A
+    {"DCX  D",          1}, // 1B
+    {"INR  E",          1}, // 1C
+    {"DCR  E",          1}, // 1D
+    {"MVI  E,#$%02x",   2}, // 1E
+    {"RAR",             1}, // 1F
+    {"???",             1}, // 20
+    {"LXI  H,#$%04x",   3}, // 21
+    {"SHLD $%04x",      3}, // 22
+    {"INX  H",          1}, // 23
+    {"INR  H",          1}, // 24
+    {"DCR  H",          1}, // 25
+    {"MVI  H,#$%02x",   2}, // 26
+    {"DAA",             1}, // 27
+    {"???",             1}, // 28
+    {"DAD  H",          1}, // 29
+    {"LHLD $%04x",      3}, // 2A
+    {"DCX  H",          1}, // 2B
+    {"INR  L",          1}, // 2C
+    {"DCR  L",          1}, // 2D
+    {"MVI  L,#$%02x",   2}, // 2E
+    {"CMA",             1}, // 2F
+    {"???",             1}, // 30
+    {"LXI  SP,#$%04x",  3}, // 31
+    {"STA  $%04x",      3}, // 32
+    {"INX  SP",         1}, // 33
+    {"INR  M",          1}, // 34
+    {"DCR  M",          1}, // 35
+    {"MVI  M,#$%02x",   2}, // 36
+    {"STC",             1}, // 37
+    {"???",             1}, // 38
+    {"DAD  SP",         1}, // 39
+    {"LDA  $%04x",      3}, // 3A
+    {"DCX  SP",         1}, // 3B
+    {"INR  A",          1}, // 3C
+    {"DCR  A",          1}, // 3D
+    {"MVI  A,#$%02x",   2}, // 3E
+    {"CMC",             1}, // 3F
+    {"MOV  B,B",        1}, // 40
+    {"MOV  B,C",        1}, // 41
+    {"MOV  B,D",        1}, // 42
+    {"MOV  B,E",        1}, // 43
+    {"MOV  B,H",        1}, // 44
+    {"MOV  B,L",        1}, // 45
+    {"MOV  B,M",        1}, // 46
+    {"MOV  B,A",        1}, // 47
+    {"MOV  C,B",        1}, // 48
+    {"MOV  C,C",        1}, // 49
+    {"MOV  C,D",        1}, // 4A
+    {"MOV  C,E",        1}, // 4B
+    {"MOV  C,H",        1}, // 4C
+    {"MOV  C,L",        1}, // 4D
+    {"MOV  C,M",        1}, // 4E
+    {"MOV  C,A",        1}, // 4F
+    {"MOV  D,B",        1}, // 50
+    {"MOV  D,C",        1}, // 51
+    {"MOV  D,D",        1}, // 52
+    {"MOV  D,E",        1}, // 53
+    {"MOV  D,H",        1}, // 54
+    {"MOV  D,L",        1}, // 55
+    {"MOV  D,M",        1}, // 56
+    {"MOV  D,A",        1}, // 57
+    {"MOV  E,B",        1}, // 58
+    {"MOV  E,C",        1}, // 59
+    {"MOV  E,D",        1}, // 5A
+    {"MOV  E,E",        1}, // 5B
+    {"MOV  E,H",        1}, // 5C
+    {"MOV  E,L",        1}, // 5D
+    {"MOV  E,M",        1}, // 5E
+    {"MOV  E,A",        1}, // 5F
+    {"MOV  H,B",        1}, // 60
+    {"MOV  H,C",        1}, // 61
+    {"MOV  H,D",        1}, // 62
+    {"MOV  H,E",        1}, // 63
+    {"MOV  H,H",        1}, // 64
+    {"MOV  H,L",        1}, // 65
+    {"MOV  H,M",        1}, // 66
+    {"MOV  H,A",        1}, // 67
+    {"MOV  L,B",        1}, // 68
+    {"MOV  L,C",        1}, // 69
+    {"MOV  L,D",        1}, // 6A
+    {"MOV  L,E",        1}, // 6B
+    {"MOV  L,H",        1}, // 6C
+    {"MOV  L,L",        1}, // 6D
+    {"MOV  L,M",        1}, // 6E
+    {"MOV  L,A",        1}, // 6F
+    {"MOV  M,B",        1}, // 70
+    {"MOV  M,C",        1}, // 71
+    {"MOV  M,D",        1}, // 72
+    {"MOV  M,E",        1}, // 73
+    {"MOV  M,H",        1}, // 74
+    {"MOV  M,L",        1}, // 75
+    {"HLT",             1}, // 76
+    {"MOV  M,A",        1}, // 77
+    {"MOV  A,B",        1}, // 78
+    {"MOV  A,C",        1}, // 79
+    {"MOV  A,D",        1}, // 7A
+    {"MOV  A,E",        1}, // 7B
+    {"MOV  A,H",        1}, // 7C
+    {"MOV  A,L",        1}, // 7D
+    {"MOV  A,M",        1}, // 7E
+    {"MOV  A,A",        1}, // 7F
+    {"ADD  B",          1}, // 80
+    {"ADD  C",          1}, // 81
+    {"ADD  D",          1}, // 82
+    {"ADD  E",          1}, // 83
+    {"ADD  H",          1}, // 84
+    {"ADD  L",          1}, // 85
+    {"ADD  M",          1}, // 86
+    {"ADD  A",          1}, // 87
+    {"ADC  B",          1}, // 88
+    {"ADC  C",          1}, // 89
+    {"ADC  D",          1}, // 8A
+    {"ADC  E",          1}, // 8B
+    {"ADC  H",          1}, // 8C
+    {"ADC  L",          1}, // 8D
+    {"ADC  M",          1}, // 8E
+    {"ADC  A",          1}, // 8F
+    {"SUB  B",          1}, // 90
+    {"SUB  C",          1}, // 91
+    {"SUB  D",          1}, // 92
+    {"SUB  E",          1}, // 93
+    {"SUB  H",          1}, // 94
+    {"SUB  L",          1}, // 95
+    {"SUB  M",          1}, // 96
+    {"SUB  A",          1}, // 97
+    {"SBB  B",          1}, // 98
+    {"SBB  C",          1}, // 99
+    {"SBB  D",          1}, // 9A
+    {"SBB  E",          1}, // 9B
+    {"SBB  H",          1}, // 9C
+    {"SBB  L",          1}, // 9D
+    {"SBB  M",          1}, // 9E
+    {"SBB  A",          1}, // 9F
+    {"ANA  B",          1}, // A0
+    {"ANA  C",          1}, // A1
+    {"ANA  D",          1}, // A2
+    {"ANA  E",          1}, // A3
+    {"ANA  H",          1}, // A4
+    {"ANA  L",          1}, // A5
+    {"ANA  M",          1}, // A6
+    {"ANA  A",          1}, // A7
+    {"XRA  B",          1}, // A8
+    {"XRA  C",          1}, // A9
+    {"XRA  D",          1}, // AA
+    {"XRA  E",          1}, // AB
+    {"XRA  H",          1}, // AC
+    {"XRA  L",          1}, // AD
+    {"XRA  M",          1}, // AE
+    {"XRA  A",          1}, // AF
+    {"ORA  B",          1}, // B0
+    {"ORA  C",          1}, // B1
+    {"ORA  D",          1}, // B2
+    {"ORA  E",          1}, // B3
+    {"ORA  H",          1}, // B4
+    {"ORA  L",          1}, // B5
+    {"ORA  M",          1}, // B6
+    {"ORA  A",          1}, // B7
+    {"CMP  B",          1}, // B8
+    {"CMP  C",          1}, // B9
+    {"CMP  D",          1}, // BA
+    {"CMP  E",          1}, // BB
+    {"CMP  H",          1}, // BC
+    {"CMP  L",          1}, // BD
+    {"CMP  M",          1}, // BE
+    {"CMP  A",          1}, // BF
+    {"RNZ",             1}, // C0
+    {"POP  B",          1}, // C1
+    {"JNZ  $%04x",      3}, // C2
+    {"JMP  $%04x",      3}, // C3
+    {"CNZ  $%04x",      3}, // C4
+    {"PUSH B",          1}, // C5
+    {"ADI  #$%02x",     2}, // C6
+    {"RST  0",          1}, // C7
+    {"RZ",              1}, // C8
+    {"RET",             1}, // C9
+    {"JZ   $%04x",      3}, // CA
+    {"???",             1}, // CB
+    {"CZ   $%04x",      3}, // CC
+    {"CALL $%04x",      3}, // CD
+    {"ACI  #$%02x",     2}, // CE
+    {"RST  1",          1}, // CF
+    {"RNC",             1}, // D0
+    {"POP  D",          1}, // D1
+    {"JNC  $%04x",      3}, // D2
+    {"OUT  #$%02x",     2}, // D3
+    {"CNC  $%04x",      3}, // D4
+    {"PUSH D",          1}, // D5
+    {"SUI  #$%02x",     2}, // D6
+    {"RST  2",          1}, // D7
+    {"RC",              1}, // D8
+    {"???",             1}, // D9
+    {"JC   $%04x",      3}, // DA
+    {"IN   #$%02x",     2}, // DB
+    {"CC   $%04x",      3}, // DC
+    {"???",             1}, // DD
+    {"SBI  #$%02x",     2}, // DE
+    {"RST  3",          1}, // DF
+    {"RPO",             1}, // E0
+    {"POP  H",          1}, // E1
+    {"JPO  $%04x",      3}, // E2
+    {"XTHL",            1}, // E3
+    {"CPO  $%04x",      3}, // E4
+    {"PUSH H",          1}, // E5
+    {"ANI  #$%02x",     2}, // E6
+    {"RST  4",          1}, // E7
+    {"RPE",             1}, // E8
+    {"PCHL",            1}, // E9
+    {"JPE  $%04x",      3}, // EA
+    {"XCHG",            1}, // EB
+    {"CPE  $%04x",      3}, // EC
+    {"???",             1}, // ED
+    {"XRI  #$%02x",     2}, // EE
+    {"RST  5",          1}, // EF
+    {"RP",              1}, // F0
+    {"POP  PSW",        1}, // F1
+    {"JP   $%04x",      3}, // F2
+    {"DI",              1}, // F3
+    {"CP   $%04x",      3}, // F4
+    {"PUSH PSW",        1}, // F5
+    {"ORI  #$%02x",     2}, // F6
+    {"RST  6",          1}, // F7
+    {"RM",              1}, // F8
+    {"SPHL",            1}, // F9
+    {"JM   $%04x",      3}, // FA
+    {"EI",              1}, // FB
+    {"CM   $%04x",      3}, // FC
+    {"???",             1}, // FD
+    {"CPI  #$%02x",     2}, // FE
+    {"RST  7",          1}, // FF
+};
+
+int Disassembler::length(uint8_t opcode){
+    return INSTRUCTIONS[opcode].length;
+}
+
+bool Disassembler::is_call(uint8_t opcode){
+    return opcode == 0xCD               // CALL
+        || (opcode & 0xC7) == 0xC4      // CNZ, CZ, CNC, CC, CPO, CPE, CP, CM
+        || (opcode & 0xC7) == 0xC7;     // RST 0-7
+}
+
+int Disassembler::disassemble(const Emulator& emu, uint16_t adress, char* text, size_t size){
+    uint16_t mask = emu.RAM_size-1;
+    uint8_t opcode = emu.memory[adress & mask];
+    const Instruction& instruction = INSTRUCTIONS[opcode];
+    uint8_t low  = emu.memory[(adress+1) & mask];
+    uint8_t high = emu.memory[(adress+2) & mask];
+
+    switch(instruction.length){
+        case 3:
+            snprintf(text, size, instruction.format, (high << 8) | low);
+            break;
+        case 2:
+            snprintf(text, size, instruction.format, low);
+            break;
+        default:
+            snprintf(text, size, "%s", instruction.format);
+            break;
+    }
+    return instruction.length;
+}
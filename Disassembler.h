@@ -0,0 +1,21 @@
+#ifndef DISASSEMBLER_H
+#define DISASSEMBLER_H
+
+#include "Emulator.h"
+#include <stdint.h>
+#include <stddef.h>
+
+// This class turns 8080 machine code back into the mnemonics of the debug output.
+
+class Disassembler
+{
+    public:
+        // length in bytes of the instruction with this opcode
+        static int length(uint8_t opcode);
+        // CALL, conditional calls and RST, which the debugger steps over
+        static bool is_call(uint8_t opcode);
+        // write the instruction at adress into text, returns its length
+        static int disassemble(const Emulator& emu, uint16_t adress, char* text, size_t size);
+};
+
+#endif // DISASSEMBLER_H
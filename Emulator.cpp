@@ -1,4 +1,7 @@
 #include "Emulator.h"
+#include "Profiler.h"
+#include "Hle.h"
+#include <string.h>
 
 //#define DEBUG
 
@@ -10,20 +13,44 @@
 
 // This class emulates the Intel 8080 CPU
 
-Emulator::Emulator()
+// number of clock cycles each opcode takes. Conditional calls and returns
+// take 6 more cycles if the branch is taken, this is added in the opcode itself.
+static const uint8_t OPCODE_CYCLES[256] = {
+//  x0  x1  x2  x3  x4  x5  x6  x7  x8  x9  xA  xB  xC  xD  xE  xF
+     4, 10,  7,  5,  5,  5,  7,  4,  4, 10,  7,  5,  5,  5,  7,  4, // 0x
+     4, 10,  7,  5,  5,  5,  7,  4,  4, 10,  7,  5,  5,  5,  7,  4, // 1x
+     4, 10, 16,  5,  5,  5,  7,  4,  4, 10, 16,  5,  5,  5,  7,  4, // 2x
+     4, 10, 13,  5, 10, 10, 10,  4,  4, 10, 13,  5,  5,  5,  7,  4, // 3x
+     5,  5,  5,  5,  5,  5,  7,  5,  5,  5,  5,  5,  5,  5,  7,  5, // 4x
+     5,  5,  5,  5,  5,  5,  7,  5,  5,  5,  5,  5,  5,  5,  7,  5, // 5x
+     5,  5,  5,  5,  5,  5,  7,  5,  5,  5,  5,  5,  5,  5,  7,  5, // 6x
+     7,  7,  7,  7,  7,  7,  7,  7,  5,  5,  5,  5,  5,  5,  7,  5, // 7x
+     4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4, // 8x
+     4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4, // 9x
+     4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4, // Ax
+     4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4, // Bx
+     5, 10, 10, 10, 11, 11,  7, 11,  5, 10, 10, 10, 11, 17,  7, 11, // Cx
+     5, 10, 10, 10, 11, 11,  7, 11,  5, 10, 10, 10, 11, 17,  7, 11, // Dx
+     5, 10, 10, 18, 11, 11,  7, 11,  5,  5, 10,  4, 11, 17,  7, 11, // Ex
+     5, 10, 10,  4, 11, 11,  7, 11,  5,  5, 10,  4, 11, 17,  7, 11  // Fx
+};
+
+Emulator::Emulator(unsigned int RAM_size, unsigned int ROM_size)
+    : RAM_size(RAM_size), ROM_size(ROM_size)
 {
+    if(RAM_size == 0 || (RAM_size & (RAM_size-1)) != 0 || RAM_size > 0x10000){
+        throw std::invalid_argument("RAM size has to be a power of two up to 64K");
+    }
     //create memory and initialize with zero
     this->memory = make_unique<unsigned char[]>(this->RAM_size);
     for(unsigned int i=0; i < this->RAM_size; i++){
         this->memory[i] = 0;
     }
     this->pc = 0;
-    this->flags.z = 0;
-    this->flags.s = 0;
-    this->flags.p = 0;
-    this->flags.cy = 0;
-    this->flags.ac = 0;
+    this->cycles = 0;
+    this->flags = FLAG_1;
     this->interrupt_enabled = false;
+    this->halted = false;
 
 }
 
@@ -33,7 +60,7 @@ Emulator::~Emulator()
 }
 
 
-void Emulator::load_program_from_file(string filename, uint16_t location)
+int Emulator::load_program_from_file(string filename, uint16_t location)
 {
     FILE * fp = fopen(filename.c_str(), "rb");
     if(fp==NULL){
@@ -43,12 +70,209 @@ void Emulator::load_program_from_file(string filename, uint16_t location)
     fseek(fp, 0L, SEEK_END);
     int filesize = ftell(fp);
     fseek(fp, 0L, SEEK_SET);
+    if(filesize < 0 || location + (unsigned int) filesize > this->RAM_size){
+        fclose(fp);
+        throw std::runtime_error("ROM File " + filename + " does not fit into memory");
+    }
 
     // copy file contents into memory
     fread(this->memory.get()+location, sizeof(char), filesize, fp);
 
     printf("Sucessfully read %d Bytes.\n", filesize);
     fclose(fp);
+    if(this->hashing) rehash();
+    forget_superinstructions(location, location + filesize);
+    return filesize;
+}
+
+void Emulator::load_program(const uint8_t* program, size_t size, uint16_t location)
+{
+    if(location + size > this->RAM_size){
+        throw std::runtime_error("Program does not fit into memory");
+    }
+    memcpy(this->memory.get()+location, program, size);
+    if(this->hashing) rehash();
+    forget_superinstructions(location, location + size);
+}
+
+void Emulator::copy_state_from(const Emulator& other){
+    if(other.RAM_size != this->RAM_size || other.ROM_size != this->ROM_size){
+        throw std::invalid_argument("Can only copy the state of an emulator with the same memory sizes");
+    }
+    this->a = other.a;
+    this->b = other.b;
+    this->c = other.c;
+    this->d = other.d;
+    this->e = other.e;
+    this->h = other.h;
+    this->l = other.l;
+    this->sp = other.sp;
+    this->pc = other.pc;
+    this->flags = other.flags;
+    this->interrupt_enabled = other.interrupt_enabled;
+    this->halted = other.halted;
+    this->cycles = other.cycles;
+    // a snapshot of the same game has the same code, then the decoded superinstructions stay valid
+    if(this->decoded_end > 0 && memcmp(this->memory.get(), other.memory.get(), this->decoded_end) != 0){
+        forget_superinstructions(0, this->decoded_end);
+    }
+    memcpy(this->memory.get(), other.memory.get(), this->RAM_size);
+    if(this->hashing){
+        if(other.hashing){
+            this->memory_hash = other.memory_hash;
+        } else {
+            rehash();
+        }
+    }
+}
+
+// the finalizer of splitmix64
+uint64_t Emulator::mix(uint64_t x){
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    return x;
+}
+
+// hash of one byte of memory, the memory hash is the XOR of all of them
+static inline uint64_t cell_hash(uint16_t adress, uint8_t value){
+    return Emulator::mix(((uint64_t) adress << 8 | value) + 0x9E3779B97F4A7C15ull);
+}
+
+uint64_t Emulator::hash_memory() const{
+    uint64_t hash = 0;
+    for(unsigned int i=0; i<this->RAM_size; i++){
+        hash ^= cell_hash(i, this->memory[i]);
+    }
+    return hash;
+}
+
+void Emulator::enable_hashing(){
+    this->hashing = true;
+    rehash();
+}
+
+void Emulator::rehash(){
+    this->memory_hash = hash_memory();
+}
+
+uint64_t Emulator::state_hash() const{
+    uint64_t registers = (uint64_t) this->a | (uint64_t) this->b << 8 | (uint64_t) this->c << 16 |
+                         (uint64_t) this->d << 24 | (uint64_t) this->e << 32 | (uint64_t) this->h << 40 |
+                         (uint64_t) this->l << 48 | (uint64_t) this->flags << 56;
+    uint64_t other = (uint64_t) this->sp | (uint64_t) this->pc << 16 |
+                     (uint64_t) this->interrupt_enabled << 32 | (uint64_t) this->halted << 33;
+    uint64_t hash = this->hashing ? this->memory_hash : hash_memory();
+    hash = mix(hash ^ registers);
+    hash = mix(hash ^ other);
+    return mix(hash ^ this->cycles);
+}
+
+void Emulator::enable_superinstructions(){
+    this->superinstructions = make_unique<uint8_t[]>(0x10000); // every pc, even above RAM_size
+    memset(this->superinstructions.get(), SUPER_UNDECODED, 0x10000);
+    this->decoded_end = 0;
+}
+
+void Emulator::forget_superinstructions(unsigned int begin, unsigned int end){
+    if(!this->superinstructions || begin >= this->decoded_end) return;
+    // the longest sequence is 5 bytes, so the 4 adresses before begin can depend on the change too
+    begin = begin >= 4 ? begin - 4 : 0;
+    end = min(end, this->decoded_end);
+    memset(this->superinstructions.get() + begin, SUPER_UNDECODED, end - begin);
+}
+
+const char* Emulator::superinstruction_name(int kind){
+    static const char* const names[SUPER_COUNT] = {
+        "undecoded", "single instruction", "MOV A,M; INX H", "DCR B; JNZ", "LDAX D; MOV M,A; INX D; INX H", "CPI; Jcc"
+    };
+    return names[kind];
+}
+
+int Emulator::superinstruction_length(int kind){
+    static const int lengths[SUPER_COUNT] = {0, 1, 2, 2, 4, 2};
+    return lengths[kind];
+}
+
+// the conditional jumps JNZ, JZ, JNC, JC, JPO, JPE, JP and JM all are 11ccc010
+static inline bool is_conditional_jump(uint8_t opcode){
+    return (opcode & 0xC7) == 0xC2;
+}
+
+// the condition of a conditional jump, call or return (bits 3-5 of the opcode)
+static inline bool condition(uint8_t opcode, uint8_t flags){
+    static const uint8_t CONDITION_FLAGS[4] = {FLAG_Z, FLAG_CY, FLAG_P, FLAG_S};
+    bool set = (flags & CONDITION_FLAGS[(opcode >> 4) & 0x03]) != 0;
+    return set == ((opcode & 0x08) != 0);
+}
+
+uint8_t Emulator::decode_superinstruction(uint16_t pc){
+    const uint8_t* code = this->memory.get();
+    uint8_t kind = SUPER_NONE;
+    // the bytes of a sequence must not run over the end of the memory
+    unsigned int left = pc < this->RAM_size ? this->RAM_size - pc : 0;
+    if(left >= 2 && code[pc] == 0x7E && code[pc+1] == 0x23){
+        kind = SUPER_LOAD_INX;
+    } else if(left >= 4 && code[pc] == 0x05 && code[pc+1] == 0xC2){
+        kind = SUPER_DCR_JNZ;
+    } else if(left >= 4 && code[pc] == 0x1A && code[pc+1] == 0x77 &&
+              ((code[pc+2] == 0x13 && code[pc+3] == 0x23) || (code[pc+2] == 0x23 && code[pc+3] == 0x13))){
+        kind = SUPER_COPY; // the order of the INX doesn't matter
+    } else if(left >= 5 && code[pc] == 0xFE && is_conditional_jump(code[pc+2])){
+        kind = SUPER_CPI_JCC;
+    }
+    this->superinstructions[pc] = kind;
+    this->decoded_end = max(this->decoded_end, min(pc + 5u, this->RAM_size));
+    return kind;
+}
+
+// returns false if the sequence has to run as single instructions
+bool Emulator::run_superinstruction(uint8_t kind){
+    const uint8_t* code = this->memory.get();
+    uint16_t pc = this->pc;
+    uint32_t temp;
+    switch(kind){
+        case SUPER_LOAD_INX:
+            if(this->cycles + 7 >= this->fuse_limit) return false;
+            this->a = read_memory(this->h, this->l);
+            temp = ((this->h << 8) | this->l) + 1;
+            this->h = (temp>>8) & 0xFF;
+            this->l = temp & 0xFF;
+            this->pc = pc + 2;
+            this->cycles += 7 + 5;
+            return true;
+        case SUPER_DCR_JNZ:
+            if(this->cycles + 5 >= this->fuse_limit) return false;
+            this->b = dcr(this->b);
+            this->pc = (this->flags & FLAG_Z) ? pc + 4 : (code[pc+3] << 8) | code[pc+2];
+            this->cycles += 5 + 10;
+            return true;
+        case SUPER_COPY:
+            if(this->cycles + 7 + 7 + 5 >= this->fuse_limit) return false;
+            // MOV M,A could overwrite the INX after it
+            temp = ((this->h << 8) | this->l) & (this->RAM_size-1);
+            if(temp >= pc + 2u && temp < pc + 4u) return false;
+            this->a = read_memory(this->d, this->e);
+            write_memory(this->h, this->l, this->a);
+            temp = ((this->d << 8) | this->e) + 1;
+            this->d = (temp>>8) & 0xFF;
+            this->e = temp & 0xFF;
+            temp = ((this->h << 8) | this->l) + 1;
+            this->h = (temp>>8) & 0xFF;
+            this->l = temp & 0xFF;
+            this->pc = pc + 4;
+            this->cycles += 7 + 7 + 5 + 5;
+            return true;
+        case SUPER_CPI_JCC:
+            if(this->cycles + 7 >= this->fuse_limit) return false;
+            sub(code[pc+1], 0);
+            this->pc = condition(code[pc+2], this->flags) ? (code[pc+4] << 8) | code[pc+3] : pc + 5;
+            this->cycles += 7 + 10;
+            return true;
+    }
+    return false;
 }
 
 void Emulator::run(){
@@ -64,24 +288,85 @@ void Emulator::unimplemented_instruction(){
     throw std::runtime_error("Unimplemented instruction!");
 }
 
-void Emulator::set_flags_no_cy(uint16_t result){
-    this->flags.z = (result & 0xff) == 0; // zero
-    this->flags.s = (result & 0x80) != 0; // sign
+// sign, zero and parity flag (and the always set bit) of every 8 bit result,
+// computed once at compile time so that the ALU only has to look them up
+struct SzpTable {
+    uint8_t flags[256];
+
+    constexpr SzpTable() : flags() {
+        for(int i=0; i<256; i++){
+            // calculate parity = even number of 1s
+            int parity = i;
+            parity ^= parity >> 4; // xor first 4 bits with last 4 bits
+            parity ^= parity >> 2; // xor last 2 bits with previous 2 bits
+            parity ^= parity >> 1; // xor last two bits together
+            this->flags[i] = (i & FLAG_S) | (i == 0 ? FLAG_Z : 0) | ((parity & 1) ? 0 : FLAG_P) | FLAG_1;
+        }
+    }
+};
+static constexpr SzpTable SZP;
 
-    // calculate parity = even number of 1s
-    uint8_t temp = result & 0xFF;
-    temp ^= temp >> 4; // xor first 4 bits with last 4 bits
-    temp ^= temp >> 2; // xor last 2 bits with previous 2 bits
-    temp ^= temp >> 1; // xor last two bits together
-    this->flags.p = (temp & 0x01) == 0;    // sum is even if last bit not set
+// sets sign, zero and parity, carry and aux carry are kept
+void Emulator::set_flags_no_cy(uint16_t result){
+    this->flags = (this->flags & (FLAG_CY | FLAG_AC)) | SZP.flags[result & 0xFF];
 }
 
+// sets sign, zero, parity and carry, aux carry is kept
 void Emulator::set_flags(uint16_t result){
-    set_flags_no_cy(result);
-    this->flags.cy= result > 0xff; // carry
+    this->flags = (this->flags & FLAG_AC) | SZP.flags[result & 0xFF] | (result > 0xff ? FLAG_CY : 0);
+}
+
+void Emulator::set_carry(bool carry){
+    this->flags = (this->flags & ~FLAG_CY) | (carry ? FLAG_CY : 0);
+}
+
+// Aux carry is the carry out of bit 3. It only depends on bit 3 of both operands
+// and of the result, so it is looked up with those three bits as index.
+// SUB_HALF_CARRY is already inverted into the aux carry of a subtraction (see sub).
+static const uint8_t HALF_CARRY[8]     = {0, 0, FLAG_AC, 0, FLAG_AC, 0, FLAG_AC, FLAG_AC};
+static const uint8_t SUB_HALF_CARRY[8] = {FLAG_AC, 0, 0, 0, FLAG_AC, FLAG_AC, FLAG_AC, 0};
+
+static inline int half_carry_index(uint8_t a, uint8_t operand, uint16_t result){
+    return ((a & 0x08) >> 1) | ((operand & 0x08) >> 2) | ((result & 0x08) >> 3);
+}
+
+// ADD, ADC, ADI and ACI
+void Emulator::add(uint8_t operand, uint8_t carry){
+    uint16_t result = (uint16_t) this->a + (uint16_t) operand + (uint16_t) carry;
+    this->flags = SZP.flags[result & 0xFF] | ((result >> 8) & FLAG_CY) | HALF_CARRY[half_carry_index(this->a, operand, result)];
+    this->a = result & 0xFF;
+}
+
+// SUB, SBB, SUI, SBI, CMP and CPI. The caller decides whether to store the result in A.
+// The 8080 subtracts by adding the complement, so aux carry is set when there is NO borrow.
+uint8_t Emulator::sub(uint8_t operand, uint8_t carry){
+    uint16_t result = (uint16_t) this->a - (uint16_t) operand - (uint16_t) carry;
+    this->flags = SZP.flags[result & 0xFF] | ((result >> 8) & FLAG_CY) | SUB_HALF_CARRY[half_carry_index(this->a, operand, result)];
+    return result & 0xFF;
+}
+
+// INR r, INR M
+uint8_t Emulator::inr(uint8_t value){
+    uint16_t result = (uint16_t) value + 1;
+    this->flags = (this->flags & FLAG_CY) | SZP.flags[result & 0xFF] | ((result & 0x0F) == 0 ? FLAG_AC : 0);
+    return result & 0xFF;
+}
+
+// DCR r, DCR M
+uint8_t Emulator::dcr(uint8_t value){
+    uint16_t result = (uint16_t) value - 1;
+    this->flags = (this->flags & FLAG_CY) | SZP.flags[result & 0xFF] | ((result & 0x0F) != 0x0F ? FLAG_AC : 0);
+    return result & 0xFF;
 }
 
 uint8_t Emulator::read_memory(uint16_t adress){
+    adress = adress & (this->RAM_size-1); // mirror adresses above RAM
+#ifdef ENABLE_DEBUGGER
+    if(this->watchpoints && (this->watchpoints[adress] & WATCH_READ)){
+        this->watch_hit = adress;
+        this->watch_hit_write = false;
+    }
+#endif
     return this->memory[adress];
 }
 
@@ -92,8 +377,22 @@ uint8_t Emulator::read_memory(uint8_t adress_a, uint8_t adress_b){
 
 void Emulator::write_memory(uint16_t adress, uint8_t data){
     // don't overwrite ROM (0000-1FFF) or out of memory
-    adress = adress & 0x3FFF; // mirror adresses above 0x4000
-    if(adress < 0x2000) return;
+    adress = adress & (this->RAM_size-1); // mirror adresses above 0x4000
+#ifdef ENABLE_DEBUGGER
+    // writes to ROM are reported too, they are usually a bug
+    if(this->watchpoints && (this->watchpoints[adress] & WATCH_WRITE)){
+        this->watch_hit = adress;
+        this->watch_hit_write = true;
+    }
+#endif
+    if(adress < this->ROM_size) return;
+    this->writes++;
+    if(this->hashing){
+        this->memory_hash ^= cell_hash(adress, this->memory[adress]) ^ cell_hash(adress, data);
+    }
+    if(adress < this->decoded_end){
+        forget_superinstructions(adress, adress + 1); // self modifying code
+    }
     this->memory[adress] = data;
 }
 
@@ -109,6 +408,8 @@ void Emulator::call(uint16_t adress, uint8_t instruction_length){
     this->sp -= 2;                               // decrement stack pointer by two bytes
     this->pc = adress;                           // set program counter to called adress
     instruction_length = 0;                      // don't increment the new adress
+    if(this->profiler) this->profiler->enter(adress);
+    if(this->hle) this->hle->call(*this, adress);
 }
 
 void Emulator::call(uint8_t adress1, uint8_t adress2, uint8_t instruction_length){
@@ -117,6 +418,7 @@ void Emulator::call(uint8_t adress1, uint8_t adress2, uint8_t instruction_length
 }
 
 void Emulator::ret(){
+    if(this->profiler) this->profiler->leave();
     // return to adress in stack pointer
     // get two byte return adress from stack
     this->pc = read_memory(this->sp) | (read_memory(this->sp+1) << 8);
@@ -127,7 +429,7 @@ void Emulator::ret(){
 
 void Emulator::arithmetic_instruction(){
     // this handles all instructions between 0x40 and 0xbf
-    uint8_t opcode = read_memory(this->pc); //this->memory[this->pc];
+    uint8_t opcode = this->memory[this->pc]; // an instruction fetch, not a read for watchpoints
 
     //special instruction in arithmetic block (replaces MOV M,M  [ M <- M]
     if (opcode == 0x76){ // HLT
@@ -199,43 +501,35 @@ void Emulator::arithmetic_instruction(){
                 this->a = operand;
                 break;
             case 0x80: // ADD
-                result = (uint16_t) this->a + (uint16_t) operand;
-                set_flags(result);
-                this->a = result & 0xFF;
+                add(operand, 0);
                 break;
             case 0x88: // ADC
-                result = (uint16_t) this->a + (uint16_t) operand + (uint16_t) this->flags.cy;
-                set_flags(result);
-                this->a = result & 0xFF;
+                add(operand, this->flags & FLAG_CY);
                 break;
             case 0x90: // SUB
-                result = (uint16_t) this->a - (uint16_t) operand;
-                set_flags(result);
-                this->a = result & 0xFF;
+                this->a = sub(operand, 0);
                 break;
             case 0x98: //SBB
-                result = (uint16_t) this->a - (uint16_t) operand - (uint16_t) this->flags.cy;
-                set_flags(result);
-                this->a = result & 0xFF;
+                this->a = sub(operand, this->flags & FLAG_CY);
                 break;
             case 0xA0: //ANA
                 result = (uint16_t) this->a & (uint16_t) operand;
-                set_flags(result);
+                // 8080 ANA sets AC from bit 3 of the operands, carry is cleared
+                this->flags = SZP.flags[result] | (((this->a | operand) & 0x08) ? FLAG_AC : 0);
                 this->a = result & 0xFF;
                 break;
             case 0xA8: //XRA
                 result = (uint16_t) this->a ^ (uint16_t) operand;
-                set_flags(result);
+                this->flags = SZP.flags[result]; // clears carry and aux carry
                 this->a = result & 0xFF;
                 break;
             case 0xB0: //ORA
                 result = (uint16_t) this->a | (uint16_t) operand;
-                set_flags(result);
+                this->flags = SZP.flags[result]; // clears carry and aux carry
                 this->a = result & 0xFF;
                 break;
             case 0xB8: //CMP
-                result = (uint16_t) this->a - (uint16_t) operand;
-                set_flags(result);
+                sub(operand, 0);
                 // compare only sets the flags, doesn't change registers
                 break;
     }
@@ -246,6 +540,19 @@ void Emulator::execute_next_instruction(){
     // temporary variables for briefness
     uint8_t* code = this->memory.get();
     uint16_t pc = this->pc;
+    uint8_t opcode = code[pc];
+
+    if(this->superinstructions){
+        uint8_t kind = this->superinstructions[pc];
+        if(kind == SUPER_UNDECODED){
+            kind = decode_superinstruction(pc);
+        }
+        if(kind != SUPER_NONE && run_superinstruction(kind)){
+            this->superinstruction_runs[kind]++;
+            return;
+        }
+        this->superinstruction_runs[SUPER_NONE]++;
+    }
 
     // temporary variable to calculate math results and flags
     uint32_t temp = 0;
@@ -278,15 +585,11 @@ void Emulator::execute_next_instruction(){
             break;
         case 0x04:
             DEBUG_PRINT("INR    B");
-            temp = (uint16_t) this->b + 1;
-            set_flags_no_cy(temp);
-            this->b = temp & 0xFF;
+            this->b = inr(this->b);
             break;
         case 0x05:
             DEBUG_PRINT("DCR    B");
-            temp = ((uint16_t) this->b) - 1;
-            set_flags_no_cy(temp);
-            this->b = temp & 0xFF;
+            this->b = dcr(this->b);
             break;
         case 0x06:
             DEBUG_PRINT("MVI    B,#$%02x", code[pc+1]);
@@ -295,8 +598,8 @@ void Emulator::execute_next_instruction(){
             break;
         case 0x07:
             DEBUG_PRINT("RLC    B"); // Rotate Accumulator left
-            this->flags.cy = (this->a & 0x80)!=0;
-            this->a = (this->a << 1) | this->flags.cy;
+            set_carry((this->a & 0x80) != 0);
+            this->a = (this->a << 1) | (this->a >> 7);
             break;
         case 0x08:
             DEBUG_PRINT("Undefined");
@@ -305,7 +608,7 @@ void Emulator::execute_next_instruction(){
         case 0x09:
             DEBUG_PRINT("DAD    B");
             temp = ((this->h << 8) | this->l) + ((this->b << 8) | this->c);
-            this->flags.cy = temp > 0xFFFF;
+            set_carry(temp > 0xFFFF);
             this->h = (temp >> 8) & 0xFF;
             this->l = temp & 0xFF;
             break;
@@ -322,15 +625,11 @@ void Emulator::execute_next_instruction(){
             break;
         case 0x0C:
             DEBUG_PRINT("INR    C");
-            temp = (uint16_t) this->c + 1;
-            set_flags_no_cy(temp);
-            this->c = temp & 0xFF;
+            this->c = inr(this->c);
             break;
         case 0x0D:
             DEBUG_PRINT("DCR    C");
-            temp = (uint16_t) this->c - 1;
-            set_flags_no_cy(temp);
-            this->c = temp & 0xFF;
+            this->c = dcr(this->c);
             break;
         case 0x0E:
             DEBUG_PRINT("MVI    C,#$%02x", code[pc+1]);
@@ -339,8 +638,8 @@ void Emulator::execute_next_instruction(){
             break;
         case 0x0F:
             DEBUG_PRINT("RRC"); // Rotate Accumulator right
-            this->flags.cy = this->a & 0x01;
-            this->a = ((this->flags.cy) << 7) | (this->a >> 1);
+            set_carry(this->a & 0x01);
+            this->a = (this->a << 7) | (this->a >> 1);
             break;
         case 0x10:
             DEBUG_PRINT("Undefined");
@@ -365,15 +664,11 @@ void Emulator::execute_next_instruction(){
             break;
         case 0x14:
             DEBUG_PRINT("INR    D");
-            temp = (uint16_t) this->d + 1;
-            set_flags_no_cy(temp);
-            this->d = temp & 0xFF;
+            this->d = inr(this->d);
             break;
         case 0x15:
             DEBUG_PRINT("DCR    D");
-            temp = (uint16_t) this->d - 1;
-            set_flags_no_cy(temp);
-            this->d = temp & 0xFF;
+            this->d = dcr(this->d);
             break;
         case 0x16:
             DEBUG_PRINT("MVI    D,#$%02x", code[pc+1]);
@@ -383,8 +678,8 @@ void Emulator::execute_next_instruction(){
         case 0x17:
             DEBUG_PRINT("RAL");  // rotate a left through carry
             temp = this->a;
-            this->a = (temp << 1) | this->flags.cy;
-            this->flags.cy = (temp & 0x80) != 0; // set carry to highest bit
+            this->a = (temp << 1) | (this->flags & FLAG_CY);
+            set_carry((temp & 0x80) != 0); // set carry to highest bit
             break;
         case 0x18:
             DEBUG_PRINT("Undefined");
@@ -393,7 +688,7 @@ void Emulator::execute_next_instruction(){
         case 0x19:
             DEBUG_PRINT("DAD    D");
             temp = ((this->h << 8) | this->l) + ((this->d << 8) | this->e);
-            this->flags.cy = temp > 0xFFFF;
+            set_carry(temp > 0xFFFF);
             this->h = (temp >> 8) & 0xFF;
             this->l = temp & 0xFF;
             break;
@@ -410,15 +705,11 @@ void Emulator::execute_next_instruction(){
             break;
         case 0x1C:
             DEBUG_PRINT("INR    E");
-            temp = (uint16_t) this->e + 1;
-            set_flags_no_cy(temp);
-            this->e = temp & 0xFF;
+            this->e = inr(this->e);
             break;
         case 0x1D:
             DEBUG_PRINT("DCR    E");
-            temp = (uint16_t) this->e - 1;
-            set_flags_no_cy(temp);
-            this->e = temp & 0xFF;
+            this->e = dcr(this->e);
             break;
         case 0x1E:
             DEBUG_PRINT("MVI    E,#$%02x", code[pc+1]);
@@ -428,8 +719,8 @@ void Emulator::execute_next_instruction(){
         case 0x1F:
             DEBUG_PRINT("RAR"); // rotate a right through carry
             temp = this->a;
-            this->a = (this->flags.cy << 7) | (temp >> 1);
-            this->flags.cy = temp & 0x01;
+            this->a = ((this->flags & FLAG_CY) << 7) | (temp >> 1);
+            set_carry(temp & 0x01);
             break;
         case 0x20:
             DEBUG_PRINT("Undefined");
@@ -458,31 +749,31 @@ void Emulator::execute_next_instruction(){
             break;
         case 0x24:
             DEBUG_PRINT("INR    H");
-            temp = (uint16_t) this->h + 1;
-            set_flags_no_cy(temp);
-            this->h = temp & 0xFF;
+            this->h = inr(this->h);
             break;
         case 0x25:
             DEBUG_PRINT("DCR    H");
-            temp = (uint16_t) this->h - 1;
-            set_flags_no_cy(temp);
-            this->h = temp & 0xFF;
+            this->h = dcr(this->h);
             break;
         case 0x26:
             DEBUG_PRINT("MVI    H,#$%02x", code[pc+1]);
             this->h = code[pc+1];
             instruction_length = 2;
             break;
-        case 0x27:
+        case 0x27:{
             DEBUG_PRINT("DAA");
-            if ((this->a & 0x0F) > 9){
-                this->a += 6;
+            // correct both BCD digits of the last addition, using the carries out of them
+            uint8_t correction = 0;
+            uint8_t carry = this->flags & FLAG_CY;
+            if ((this->flags & FLAG_AC) || (this->a & 0x0F) > 9){
+                correction |= 0x06;
+            }
+            if ((this->flags & FLAG_CY) || (this->a >> 4) > 9 || ((this->a >> 4) >= 9 && (this->a & 0x0F) > 9)){
+                correction |= 0x60;
+                carry = 1; // the carry is only ever set by DAA, never cleared
             }
-            // (this->flags.cy==1) ||
-            if ( ((this->a & 0xF0) > 0x90)){
-                temp = (uint16_t) this->a + 0x60;
-                set_flags(temp);
-                this->a = temp & 0xFF;
+            add(correction, 0);
+            this->flags |= carry;
             }
             break;
         case 0x28:
@@ -492,7 +783,7 @@ void Emulator::execute_next_instruction(){
         case 0x29:
             DEBUG_PRINT("DAD    H");
             temp = ((this->h << 8) | this->l) + ((this->h << 8) | this->l);
-            this->flags.cy = temp > 0xFFFF;
+            set_carry(temp > 0xFFFF);
             this->h = (temp >> 8) & 0xFF;
             this->l = temp & 0xFF;
             break;
@@ -511,15 +802,11 @@ void Emulator::execute_next_instruction(){
             break;
         case 0x2C:
             DEBUG_PRINT("INR    L");
-            temp = (uint16_t) this->l + 1;
-            set_flags_no_cy(temp);
-            this->l = temp & 0xFF;
+            this->l = inr(this->l);
             break;
         case 0x2D:
             DEBUG_PRINT("DCR    L");
-            temp = (uint16_t) this->l - 1;
-            set_flags_no_cy(temp);
-            this->l = temp & 0xFF;
+            this->l = dcr(this->l);
             break;
         case 0x2E:
             DEBUG_PRINT("MVI    L,#$%02x", code[pc+1]);
@@ -550,15 +837,11 @@ void Emulator::execute_next_instruction(){
             break;
         case 0x34:
             DEBUG_PRINT("INR    M");
-            temp = (uint16_t) read_memory(this->h,this->l) + 1;
-            set_flags_no_cy(temp);
-            write_memory(this->h,this->l,temp & 0xFF);
+            write_memory(this->h,this->l,inr(read_memory(this->h,this->l)));
             break;
         case 0x35:
             DEBUG_PRINT("DCR    M");
-            temp = (uint16_t) read_memory(this->h,this->l) - 1;
-            set_flags_no_cy(temp);
-            write_memory(this->h,this->l,temp & 0xFF);
+            write_memory(this->h,this->l,dcr(read_memory(this->h,this->l)));
             break;
         case 0x36:
             DEBUG_PRINT("MVI    M,#$%02x", code[pc+1]);
@@ -567,7 +850,7 @@ void Emulator::execute_next_instruction(){
             break;
         case 0x37:
             DEBUG_PRINT("STC");
-            this->flags.cy = 1;
+            this->flags |= FLAG_CY;
             break;
         case 0x38:
             DEBUG_PRINT("Undefined");
@@ -577,7 +860,7 @@ void Emulator::execute_next_instruction(){
             DEBUG_PRINT("DAD    SP");
             // make the registers a single 16 bit number and add stack pionter
             temp = ((this->h << 8) | this->l) + this->sp;
-            this->flags.cy = temp > 0xFFFF;
+            set_carry(temp > 0xFFFF);
             this->h = (temp >> 8) & 0xFF;
             this->l = temp & 0xFF;
             break;
@@ -592,15 +875,11 @@ void Emulator::execute_next_instruction(){
             break;
         case 0x3C:
             DEBUG_PRINT("INR    A");
-            temp = this->a + 1;
-            set_flags_no_cy(temp);
-            this->a = temp & 0xFF;
+            this->a = inr(this->a);
             break;
         case 0x3D:
             DEBUG_PRINT("DCR    A");
-            temp = this->a - 1;
-            set_flags_no_cy(temp);
-            this->a = temp & 0xFF;
+            this->a = dcr(this->a);
             break;
         case 0x3E:
             DEBUG_PRINT("MVI    A,#$%02x", code[pc+1]);
@@ -609,7 +888,7 @@ void Emulator::execute_next_instruction(){
             break;
         case 0x3F:
             DEBUG_PRINT("CMC");
-            this->flags.cy = ~this->flags.cy;
+            this->flags ^= FLAG_CY;
             break;
         case 0x40:
             DEBUG_PRINT("MOV    B,B");
@@ -829,7 +1108,9 @@ void Emulator::execute_next_instruction(){
             break;
         case 0x76:
             DEBUG_PRINT("HLT");
-            exit(0); // halt = end program
+            // stay on this instruction until an interrupt arrives (see Machine::interrupt)
+            this->halted = true;
+            instruction_length = 0;
             break;
         case 0x77:
             DEBUG_PRINT("MOV    M,A");
@@ -1125,8 +1406,9 @@ void Emulator::execute_next_instruction(){
             break;
         case 0xC0:
             DEBUG_PRINT("RNZ     ");
-            if(this->flags.z == 0){
+            if((this->flags & FLAG_Z) == 0){
                 ret(); //return
+                this->cycles += 6; // taken return
                 instruction_length = 0; // Don't increment pc after return (CALL aready set this to next instruction)
             } else {
                 instruction_length = 1;
@@ -1140,7 +1422,7 @@ void Emulator::execute_next_instruction(){
             break;
         case 0xC2:
             DEBUG_PRINT("JNZ    $%02x%02x", code[pc+2],code[pc+1]);
-            if(this->flags.z == 0){ // zero flag is 0 (not set), so jump
+            if((this->flags & FLAG_Z) == 0){ // zero flag is 0 (not set), so jump
                 this->pc = (code[pc+2] << 8) | code[pc+1];
                 instruction_length = 0; // Keep the program counter at the pointed adress
             } else {
@@ -1155,8 +1437,9 @@ void Emulator::execute_next_instruction(){
         case 0xC4:
             DEBUG_PRINT("CNZ    $%02x%02x", code[pc+2],code[pc+1]);
             // call if not zero
-            if(this->flags.z == 0){
+            if((this->flags & FLAG_Z) == 0){
                 call(code[pc+2], code[pc+1], 3);
+                this->cycles += 6; // taken call
                 instruction_length = 0;
             } else {
                 instruction_length = 3;
@@ -1170,9 +1453,7 @@ void Emulator::execute_next_instruction(){
             break;
         case 0xC6:
             DEBUG_PRINT("ADI    #$%02x", code[pc+1]);
-            temp = this->a + code[pc+1];
-            set_flags(temp);
-            this->a = temp & 0xFF;
+            add(code[pc+1], 0);
             instruction_length = 2;
             break;
         case 0xC7:
@@ -1183,8 +1464,9 @@ void Emulator::execute_next_instruction(){
         case 0xC8:
             DEBUG_PRINT("RZ");
             // return if zero
-            if(this->flags.z){
+            if(this->flags & FLAG_Z){
                 ret(); //return
+                this->cycles += 6; // taken return
                 instruction_length = 0; // Don't increment pc after return (CALL aready set this to next instruction)
             } else {
                 instruction_length = 1;
@@ -1198,7 +1480,7 @@ void Emulator::execute_next_instruction(){
         case 0xCA:
             DEBUG_PRINT("JZ     $%02x%02x", code[pc+2],code[pc+1]);
             // jump if zero
-            if(this->flags.z){
+            if(this->flags & FLAG_Z){
                 this->pc = (code[pc+2] << 8) | code[pc+1];
                 instruction_length = 0; // don't increment pc beyond the jump adress
             } else {
@@ -1212,8 +1494,9 @@ void Emulator::execute_next_instruction(){
         case 0xCC:
             DEBUG_PRINT("CZ     $%02x%02x", code[pc+2],code[pc+1]);
             // call if zero flag
-            if(this->flags.z == 1){
+            if(this->flags & FLAG_Z){
                 call(code[pc+2], code[pc+1], 3);
+                this->cycles += 6; // taken call
                 instruction_length = 0;
             } else {
                 instruction_length = 3;
@@ -1226,9 +1509,7 @@ void Emulator::execute_next_instruction(){
             break;
         case 0xCE:
             DEBUG_PRINT("ACI    #$%02x", code[pc+1]);
-            temp = this->a + code[pc+1] + this->flags.cy;
-            set_flags(temp);
-            this->a = temp & 0xFF;
+            add(code[pc+1], this->flags & FLAG_CY);
             instruction_length = 2;
             break;
         case 0xCF:
@@ -1239,8 +1520,9 @@ void Emulator::execute_next_instruction(){
         case 0xD0:
             DEBUG_PRINT("RNC");
             // return if no carry (carry bit is zero)
-            if(this->flags.cy == 0){
+            if((this->flags & FLAG_CY) == 0){
                 ret(); //return
+                this->cycles += 6; // taken return
                 instruction_length = 0; // Don't increment pc after return (CALL aready set this to next instruction)
             } else {
                 instruction_length = 1;
@@ -1255,7 +1537,7 @@ void Emulator::execute_next_instruction(){
         case 0xD2:
             DEBUG_PRINT("JNC    $%02x%02x", code[pc+2],code[pc+1]);
             // jump if not carry
-            if(this->flags.cy == 0){
+            if((this->flags & FLAG_CY) == 0){
                 this->pc = (code[pc+2] << 8) | code[pc+1];
                 instruction_length = 0; // don't increment pc beyond the jump adress
             } else {
@@ -1269,8 +1551,9 @@ void Emulator::execute_next_instruction(){
         case 0xD4:
             DEBUG_PRINT("CNC    $%02x%02x", code[pc+2],code[pc+1]);
             // call if not carry
-            if(this->flags.cy == 0){
+            if((this->flags & FLAG_CY) == 0){
                 call(code[pc+2], code[pc+1], 3);
+                this->cycles += 6; // taken call
                 instruction_length = 0;
             } else {
                 instruction_length = 3;
@@ -1284,9 +1567,7 @@ void Emulator::execute_next_instruction(){
             break;
         case 0xD6:
             DEBUG_PRINT("SUI    #$%02x", code[pc+1]);
-            temp = this->a - code[pc+1];
-            set_flags(temp);
-            this->a = temp & 0xFF;
+            this->a = sub(code[pc+1], 0);
             instruction_length = 2;
             break;
         case 0xD7:
@@ -1296,8 +1577,9 @@ void Emulator::execute_next_instruction(){
             break;
         case 0xD8:
             DEBUG_PRINT("RC");
-            if(this->flags.cy){
+            if(this->flags & FLAG_CY){
                 ret(); //return
+                this->cycles += 6; // taken return
                 instruction_length = 0; // Don't increment pc after return (CALL aready set this to next instruction)
             } else {
                 instruction_length = 1;
@@ -1310,7 +1592,7 @@ void Emulator::execute_next_instruction(){
         case 0xDA:
             DEBUG_PRINT("JC    $%02x%02x", code[pc+2],code[pc+1]);
             // jump if carry
-            if(this->flags.cy){
+            if(this->flags & FLAG_CY){
                 this->pc = (code[pc+2] << 8) | code[pc+1];
                 instruction_length = 0; // don't increment pc beyond the jump adress
             } else {
@@ -1324,8 +1606,9 @@ void Emulator::execute_next_instruction(){
         case 0xDC:
             DEBUG_PRINT("CC    $%02x%02x", code[pc+2],code[pc+1]);
             // call if carry
-            if(this->flags.cy){
+            if(this->flags & FLAG_CY){
                 call(code[pc+2], code[pc+1], 3);
+                this->cycles += 6; // taken call
                 instruction_length = 0;
             } else {
                 instruction_length = 3;
@@ -1337,9 +1620,7 @@ void Emulator::execute_next_instruction(){
             break;
         case 0xDE:
             DEBUG_PRINT("SBI   #$%02x", code[pc+1]);
-            temp = this->a - code[pc+1] - this->flags.cy;
-            set_flags(temp);
-            this->a = temp & 0xFF;
+            this->a = sub(code[pc+1], this->flags & FLAG_CY);
             instruction_length = 2;
             break;
         case 0xDF:
@@ -1349,9 +1630,10 @@ void Emulator::execute_next_instruction(){
             break;
         case 0xE0:
             DEBUG_PRINT("RPO");
-            // return if parity odd (sign bit is zero)
-            if(this->flags.s == 0){
+            // return if parity odd (parity bit is zero)
+            if((this->flags & FLAG_P) == 0){
                 ret(); //return
+                this->cycles += 6; // taken return
                 instruction_length = 0; // Don't increment pc after return (CALL aready set this to next instruction)
             } else {
                 instruction_length = 1;
@@ -1366,7 +1648,7 @@ void Emulator::execute_next_instruction(){
         case 0xE2:
             DEBUG_PRINT("JPO   $%02x%02x", code[pc+2],code[pc+1]);
             // jump if parity odd
-            if(this->flags.p == 0){
+            if((this->flags & FLAG_P) == 0){
                 this->pc = (code[pc+2] << 8) | code[pc+1];
                 instruction_length = 0; // don't increment pc beyond the jump adress
             } else {
@@ -1387,8 +1669,9 @@ void Emulator::execute_next_instruction(){
         case 0xE4:
             DEBUG_PRINT("CPO   $%02x%02x", code[pc+2],code[pc+1]);
             // call if parity odd
-            if(this->flags.p == 0){
+            if((this->flags & FLAG_P) == 0){
                 call(code[pc+2], code[pc+1], 3);
+                this->cycles += 6; // taken call
                 instruction_length = 0;
             } else {
                 instruction_length = 3;
@@ -1402,8 +1685,9 @@ void Emulator::execute_next_instruction(){
             break;
         case 0xE6:
             DEBUG_PRINT("ANI   #$%02x", code[pc+1]);
+            // AC from bit 3 of the operands like ANA, carry is cleared
+            this->flags = SZP.flags[this->a & code[pc+1]] | (((this->a | code[pc+1]) & 0x08) ? FLAG_AC : 0);
             this->a = this->a & code[pc+1];
-            set_flags(this->a); // this should also reset carry since temp <= 0xFF
             instruction_length = 2;
             break;
         case 0xE7:
@@ -1413,8 +1697,9 @@ void Emulator::execute_next_instruction(){
             break;
         case 0xE8:
             DEBUG_PRINT("RPE");
-            if(this->flags.p){
+            if(this->flags & FLAG_P){
                 ret(); //return
+                this->cycles += 6; // taken return
                 instruction_length = 0; // Don't increment pc after return (CALL aready set this to next instruction)
             } else {
                 instruction_length = 1;
@@ -1428,7 +1713,7 @@ void Emulator::execute_next_instruction(){
         case 0xEA:
             DEBUG_PRINT("JPE   $%02x%02x", code[pc+2],code[pc+1]);
             // jump if parity even
-            if(this->flags.p){
+            if(this->flags & FLAG_P){
                 this->pc = (code[pc+2] << 8) | code[pc+1];
                 instruction_length = 0; // don't increment pc beyond the jump adress
             } else {
@@ -1449,8 +1734,9 @@ void Emulator::execute_next_instruction(){
         case 0xEC:
             DEBUG_PRINT("CPE   $%02x%02x", code[pc+2],code[pc+1]);
             // call if parity even
-            if(this->flags.p){
+            if(this->flags & FLAG_P){
                 call(code[pc+2], code[pc+1], 3);
+                this->cycles += 6; // taken call
                 instruction_length = 0;
             } else {
                 instruction_length = 3;
@@ -1463,7 +1749,7 @@ void Emulator::execute_next_instruction(){
         case 0xEE:
             DEBUG_PRINT("XRI   #$%02x", code[pc+1]);
             this->a = this->a ^ code[pc+1];
-            set_flags(this->a); // this should also reset carry since temp <= 0xFF
+            this->flags = SZP.flags[this->a]; // clears carry and aux carry
             instruction_length = 2;
             break;
         case 0xEF:
@@ -1474,8 +1760,9 @@ void Emulator::execute_next_instruction(){
         case 0xF0:
             DEBUG_PRINT("RP");
             // return if plus
-            if(this->flags.s == 0){
+            if((this->flags & FLAG_S) == 0){
                 ret(); //return
+                this->cycles += 6; // taken return
                 instruction_length = 0; // Don't increment pc after return (CALL aready set this to next instruction)
             } else {
                 instruction_length = 1;
@@ -1484,20 +1771,14 @@ void Emulator::execute_next_instruction(){
         case 0xF1:
             DEBUG_PRINT("POP PSW"); // load flags and accumulator from stack
             this->a = read_memory(this->sp+1);
-            // Load flags from stack: sz0a0pc
-            temp = read_memory(this->sp);
-
-            this->flags.s  = (temp & 0x80) !=0;
-            this->flags.z  = (temp & 0x40) !=0;
-            this->flags.ac = (temp & 0x10) !=0;
-            this->flags.p  = (temp & 0x04) !=0;
-            this->flags.cy = (temp & 0x01) !=0;
+            // Load flags from stack: sz0a0p1c, the constant bits stay as they are
+            this->flags = (read_memory(this->sp) & (FLAG_S | FLAG_Z | FLAG_AC | FLAG_P | FLAG_CY)) | FLAG_1;
             this->sp += 2;
             break;
         case 0xF2:
             DEBUG_PRINT("JP    $%02x%02x", code[pc+2],code[pc+1]);
             // jump if plus
-            if(this->flags.s == 0){
+            if((this->flags & FLAG_S) == 0){
                 this->pc = (code[pc+2] << 8) | code[pc+1];
                 instruction_length = 0; // don't increment pc beyond the jump adress
             } else {
@@ -1511,8 +1792,9 @@ void Emulator::execute_next_instruction(){
         case 0xF4:
             DEBUG_PRINT("CP    $%02x%02x", code[pc+2],code[pc+1]);
             // call if plus
-            if(this->flags.s == 0){
+            if((this->flags & FLAG_S) == 0){
                 call(code[pc+2], code[pc+1], 3);
+                this->cycles += 6; // taken call
                 instruction_length = 0;
             } else {
                 instruction_length = 3;
@@ -1520,24 +1802,15 @@ void Emulator::execute_next_instruction(){
             break;
         case 0xF5:
             DEBUG_PRINT("PUSH PSW");// (sp-2)<-flags; (sp-1)<-A; sp <- sp - 2
-            // The byte looks like this: sz0a0p1c
-
-            temp = (this->flags.s  << 7)
-                 | (this->flags.z  << 6)
-                 // bit 5 always zero
-                 | (this->flags.ac << 4)
-                 // bit 3 always zero
-                 | (this->flags.p  << 2)
-                 | (1              << 1) // bit one always once
-                 | (this->flags.cy);
+            // The flags are already stored like the byte: sz0a0p1c
             write_memory(this->sp-1, this->a);
-            write_memory(this->sp-2, temp & 0xFF);
+            write_memory(this->sp-2, this->flags);
             this->sp -= 2;
             break;
         case 0xF6:
             DEBUG_PRINT("ORI   #$%02x", code[pc+1]);
             this->a = this->a | code[pc+1];
-            set_flags(this->a); // this should also reset carry since temp <= 0xFF
+            this->flags = SZP.flags[this->a]; // clears carry and aux carry
             instruction_length = 2;
             break;
         case 0xF7:
@@ -1548,8 +1821,9 @@ void Emulator::execute_next_instruction(){
         case 0xF8:
             DEBUG_PRINT("RM");
             // Return if minus (sign flag)
-            if(this->flags.s){
+            if(this->flags & FLAG_S){
                 ret(); //return
+                this->cycles += 6; // taken return
                 instruction_length = 0; // Don't increment pc after return (CALL aready set this to next instruction)
             } else {
                 instruction_length = 1;
@@ -1562,7 +1836,7 @@ void Emulator::execute_next_instruction(){
         case 0xFA:
             DEBUG_PRINT("JM    $%02x%02x", code[pc+2],code[pc+1]);
             // Jump if minus (sign flag)
-            if(this->flags.s){
+            if(this->flags & FLAG_S){
                 this->pc = (code[pc+2] << 8) | code[pc+1];
                 instruction_length = 0;
             } else {
@@ -1576,8 +1850,9 @@ void Emulator::execute_next_instruction(){
         case 0xFC:
             DEBUG_PRINT("CM    $%02x%02x", code[pc+2],code[pc+1]);
             // Call if minus (sign flag)
-            if(this->flags.s){
+            if(this->flags & FLAG_S){
                 call(code[pc+2],code[pc+1],3);
+                this->cycles += 6; // taken call
                 instruction_length = 0;
             } else {
                 instruction_length = 3;
@@ -1589,8 +1864,7 @@ void Emulator::execute_next_instruction(){
             break;
         case 0xFE:
             DEBUG_PRINT("CPI    #$%02x", code[pc+1]);
-            temp = (uint16_t) this->a - (uint16_t) code[pc+1];
-            set_flags(temp);
+            sub(code[pc+1], 0); // compare only sets the flags
             instruction_length = 2;
             break;
         case 0xFF:
@@ -1604,9 +1878,10 @@ void Emulator::execute_next_instruction(){
 
     }
     //DEBUG_PRINT("%02X",read_memory(this->h,this->l));
-    DEBUG_PRINT("\n%c%c%c%c%c", (this->flags.z == 0) ? ('.') : ('z'), (this->flags.s == 0) ? ('.') : ('s'), (this->flags.p == 0) ? ('.') : ('p'), (this->flags.cy == 0) ? ('.') : ('c'), (this->flags.ac == 0) ? ('.') : ('a'));
+    DEBUG_PRINT("\n%c%c%c%c%c", (this->flags & FLAG_Z) ? ('z') : ('.'), (this->flags & FLAG_S) ? ('s') : ('.'), (this->flags & FLAG_P) ? ('p') : ('.'), (this->flags & FLAG_CY) ? ('c') : ('.'), (this->flags & FLAG_AC) ? ('a') : ('.'));
     DEBUG_PRINT(" REG: A %02X B %02X C %02X D %02X E %02X H %02X L %02X SP %02X", this->a,this->b,this->c,this->d,this->e,this->h,this->l,this->sp);
     DEBUG_PRINT("\n");
 
     this->pc += instruction_length;
+    this->cycles += OPCODE_CYCLES[opcode];
 }
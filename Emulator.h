@@ -8,31 +8,74 @@
 
 using namespace std;
 
-// flags as a bit field
+class Profiler;
+class Hle;
 
-typedef struct flags_st {
-    uint8_t z:1; //result is zero
-    uint8_t s:1; //most significant bit of result
-    uint8_t p:1; //parity of result
-    uint8_t cy:1;// carry
-    uint8_t ac:1;// aux carry
-    uint8_t pad:3; // padding to a byte?
-} flags_st;
+// flags are kept packed like the PSW byte that PUSH PSW stores: sz0a0p1c
+
+enum FlagBits : uint8_t {
+    FLAG_CY = 0x01, // carry
+    FLAG_1  = 0x02, // always set
+    FLAG_P  = 0x04, // parity of result
+    FLAG_AC = 0x10, // aux carry
+    FLAG_Z  = 0x40, // result is zero
+    FLAG_S  = 0x80, // most significant bit of result
+};
+
+#ifdef ENABLE_DEBUGGER
+// kinds of memory accesses a watchpoint stops at
+enum WatchBits : uint8_t {
+    WATCH_READ  = 0x01,
+    WATCH_WRITE = 0x02,
+};
+#endif
+
+// short instruction sequences the ROMs use all the time, run as one superinstruction
+enum Superinstruction : uint8_t {
+    SUPER_UNDECODED, // not looked at yet
+    SUPER_NONE,      // the instruction runs on its own
+    SUPER_LOAD_INX,  // MOV A,M; INX H
+    SUPER_DCR_JNZ,   // DCR B; JNZ
+    SUPER_COPY,      // LDAX D; MOV M,A; INX D; INX H (or INX H; INX D)
+    SUPER_CPI_JCC,   // CPI and a conditional jump
+    SUPER_COUNT
+};
 
 
 class Emulator
 {
     public:
-        Emulator();
+        // memory above RAM_size mirrors the lower addresses, the first ROM_size bytes are read only
+        Emulator(unsigned int RAM_size = 0x4000, unsigned int ROM_size = 0x2000);
         virtual ~Emulator();
 
-        void load_program_from_file(string filename, uint16_t location = 0);
+        int load_program_from_file(string filename, uint16_t location = 0);
+        void load_program(const uint8_t* program, size_t size, uint16_t location = 0);
         void run();
         void execute_next_instruction();
         void call(uint16_t adress, uint8_t instruction_length);
         void call(uint8_t adress1, uint8_t adress2, uint8_t instruction_length);
+        // registers, flags, cycles and memory of an emulator with the same memory sizes
+        void copy_state_from(const Emulator& other);
 
-        unsigned int RAM_size = 0x4000;
+        // hash of registers, flags, interrupt state, cycles and memory, e.g. to find where two runs differ.
+        // With hashing on, write_memory keeps the hash of the memory up to date, so this is cheap
+        uint64_t state_hash() const;
+        void enable_hashing();
+        void rehash(); // after the memory was changed without write_memory
+        static uint64_t mix(uint64_t x); // scrambles all bits, for combining hashes
+
+        // Runs the sequences of Superinstruction in one step, with the flags and cycles of the single
+        // instructions. What starts at an adress is decoded the first time it runs and kept until the
+        // memory there changes. A sequence is only fused if all but its last instruction start before
+        // fuse_limit, so that interrupts come between the same instructions as without
+        void enable_superinstructions();
+        void forget_superinstructions(unsigned int begin, unsigned int end); // after memory was changed without write_memory
+        static const char* superinstruction_name(int kind);
+        static int superinstruction_length(int kind); // in instructions
+
+        unsigned int RAM_size = 0x4000; // has to be a power of two
+        unsigned int ROM_size = 0x2000;
 
         //Registers
         uint8_t a = 0;
@@ -45,20 +88,49 @@ class Emulator
         uint16_t sp = 0; // stack pointer
         uint16_t pc = 0; // program counter
         unique_ptr<uint8_t[]> memory; // pointer to RAM
-        struct flags_st flags;
+        uint8_t flags = FLAG_1;
         bool interrupt_enabled; // is interrupt enabled?
+        bool halted = false;    // HLT was executed, waiting for an interrupt
+        uint64_t cycles = 0; // clock cycles executed since power on
+        Profiler* profiler = nullptr; // gets every call and return while profiling
+        Hle* hle = nullptr;           // runs native versions of hooked ROM routines
+        bool hashing = false;         // memory_hash is kept up to date
+        uint64_t memory_hash = 0;     // XOR of the hashes of every adress and its value
+        uint64_t fuse_limit = 0;      // cycle up to which instructions may be fused, 0 = never
+        uint64_t writes = 0;          // to RAM so far, to see if a loop changed the memory
+        uint64_t superinstruction_runs[SUPER_COUNT] = {}; // SUPER_NONE counts the single instructions
+
+#ifdef ENABLE_DEBUGGER
+        // WATCH_READ/WATCH_WRITE bits of every (mirrored) adress, set by the debugger, nullptr = none
+        const uint8_t* watchpoints = nullptr;
+        int watch_hit = -1;           // adress of the last access that hit a watchpoint, -1 = none
+        bool watch_hit_write = false; // that access was a write
+#endif
 
     private:
+        friend class Hle; // the native routines use the memory access and RET of the CPU
+
         // internal function to implement opcodes
         void unimplemented_instruction();
         void set_flags_no_cy(uint16_t result);
         void set_flags(uint16_t result);
+        void set_carry(bool carry);
+        void add(uint8_t operand, uint8_t carry);
+        uint8_t sub(uint8_t operand, uint8_t carry);
+        uint8_t inr(uint8_t value);
+        uint8_t dcr(uint8_t value);
         void arithmetic_instruction();
         uint8_t read_memory(uint16_t adress);
         uint8_t read_memory(uint8_t adress_a, uint8_t adress_b);
         void write_memory(uint16_t adress, uint8_t data);
         void write_memory(uint8_t adress_a, uint8_t adress_b, uint8_t data);
         void ret();
+        uint64_t hash_memory() const;
+
+        unique_ptr<uint8_t[]> superinstructions; // Superinstruction starting at every adress
+        unsigned int decoded_end = 0;            // the decoded ones only depend on memory below this
+        uint8_t decode_superinstruction(uint16_t pc);
+        bool run_superinstruction(uint8_t kind);
 };
 
 #endif // EMULATOR_H
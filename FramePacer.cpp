@@ -0,0 +1,91 @@
+#include "FramePacer.h"
+#include <errno.h>
+#include <stdio.h>
+
+FramePacer::FramePacer(uint64_t frame_ns)
+    : frame_ns(frame_ns)
+{
+    restart();
+}
+
+FramePacer::~FramePacer()
+{
+}
+
+uint64_t FramePacer::now(clockid_t clock){
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void FramePacer::pause(){
+    // fast-forward isn't counted, it uses the CPU on purpose
+    if(this->start_ns){
+        this->paced_ns += now(CLOCK_MONOTONIC) - this->start_ns;
+        this->paced_cpu_ns += now(CLOCK_PROCESS_CPUTIME_ID) - this->start_cpu_ns;
+        this->start_ns = 0;
+    }
+}
+
+void FramePacer::restart(){
+    pause();
+    this->start_ns = now(CLOCK_MONOTONIC);
+    this->start_cpu_ns = now(CLOCK_PROCESS_CPUTIME_ID);
+    this->next = this->start_ns;
+}
+
+void FramePacer::wait(){
+    this->next += this->frame_ns;
+    uint64_t time = now(CLOCK_MONOTONIC);
+    if(time > this->next + this->frame_ns){
+        // the host fell behind, start again from now instead of catching up
+        this->behind++;
+        this->next = time;
+        return;
+    }
+    struct timespec deadline;
+    deadline.tv_sec = this->next / 1000000000;
+    deadline.tv_nsec = this->next % 1000000000;
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR){
+        // a signal woke us up early, the deadline stays the same
+    }
+
+    uint64_t late = now(CLOCK_MONOTONIC) - this->next;
+    if((int64_t) late < 0) late = 0;
+    this->wakeups++;
+    this->late_total_ns += late;
+    if(late > this->late_max_ns) this->late_max_ns = late;
+    uint64_t us = late / 1000;
+    this->late_us[us < HISTOGRAM_US ? us : HISTOGRAM_US]++;
+}
+
+void FramePacer::print_statistics() const{
+    uint64_t wall = this->paced_ns;
+    uint64_t cpu = this->paced_cpu_ns;
+    if(this->start_ns){
+        wall += now(CLOCK_MONOTONIC) - this->start_ns;
+        cpu += now(CLOCK_PROCESS_CPUTIME_ID) - this->start_cpu_ns;
+    }
+    if(wall == 0 || this->wakeups == 0) return;
+
+    // the wake-up delay that 50% and 99% of the frames stayed below
+    uint64_t median = 0, p99 = 0, count = 0;
+    bool found_median = false;
+    for(int us=0; us<=HISTOGRAM_US; us++){
+        count += this->late_us[us];
+        if(!found_median && count*2 >= this->wakeups){
+            median = us;
+            found_median = true;
+        }
+        if(count*100 >= this->wakeups*99){
+            p99 = us;
+            break;
+        }
+    }
+    printf("Pacing: %.1f%% CPU over %.1f s, %llu frames started late\n",
+        100.0 * cpu / wall, wall / 1e9, (unsigned long long) this->behind);
+    printf("Wake-up jitter of %llu frames: mean %.1f us, median < %llu us, 99%% < %llu%s us, max %.1f us\n",
+        (unsigned long long) this->wakeups, this->late_total_ns / 1e3 / this->wakeups,
+        (unsigned long long) median + 1, (unsigned long long) p99 + 1, p99 == HISTOGRAM_US ? "+" : "",
+        this->late_max_ns / 1e3);
+}
@@ -0,0 +1,47 @@
+#ifndef FRAMEPACER_H
+#define FRAMEPACER_H
+
+#include <stdint.h>
+#include <time.h>
+
+using namespace std;
+
+// This class keeps the emulation at the speed of the real machine with as little CPU as
+// possible, e.g. for a cabinet that runs for days: a frame is emulated in one burst, then
+// the thread sleeps until the start of the next frame with clock_nanosleep. The deadlines
+// are absolute, so the time spent emulating and the wake-up delay don't add up over the
+// frames. The keys are read right after waking up, so a key press reaches the next frame.
+// It measures the CPU time of the process and how late every wake-up is (--pace-stats).
+
+class FramePacer
+{
+    public:
+        FramePacer(uint64_t frame_ns);
+        virtual ~FramePacer();
+
+        void restart(); // the next frame starts now, e.g. after fast-forward
+        void pause();   // fast-forward, the time until restart doesn't count
+        void wait();    // sleeps until the next frame is due
+        void print_statistics() const;
+        uint64_t late_frames() const { return this->behind; }
+
+    private:
+        static const int HISTOGRAM_US = 2000; // wake-ups later than this go into the last bucket
+
+        uint64_t frame_ns;
+        uint64_t next = 0;          // deadline of the next frame, CLOCK_MONOTONIC in ns
+        uint64_t start_ns = 0;      // wall and CPU time when pacing (re)started
+        uint64_t start_cpu_ns = 0;
+        uint64_t paced_ns = 0;      // wall time and CPU time of the paced periods before
+        uint64_t paced_cpu_ns = 0;
+
+        uint64_t wakeups = 0;
+        uint64_t late_total_ns = 0;
+        uint64_t late_max_ns = 0;
+        uint32_t late_us[HISTOGRAM_US + 1] = {}; // wake-ups by how many us they came late
+        uint64_t behind = 0;        // frames that started late because the host was too slow
+
+        static uint64_t now(clockid_t clock);
+};
+
+#endif // FRAMEPACER_H
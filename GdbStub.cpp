@@ -0,0 +1,382 @@
+#include "GdbStub.h"
+
+#ifdef ENABLE_DEBUGGER
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdexcept>
+
+static const int SIGNAL_INT  = 2;
+static const int SIGNAL_TRAP = 5;
+static const size_t MAX_MEMORY_READ = 0x800; // bytes per m packet
+
+static void set_nonblocking(int fd){
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+static string hex_byte(uint8_t value){
+    char text[3];
+    snprintf(text, sizeof(text), "%02x", value);
+    return text;
+}
+
+static uint8_t parse_hex_byte(const string& text, size_t i){
+    return (uint8_t) stoul(text.substr(i, 2), nullptr, 16);
+}
+
+GdbStub::GdbStub(Emulator& emu, Debugger& debugger, const string& adress)
+    : emu(emu), debugger(debugger)
+{
+    bool is_port = !adress.empty() && adress.find_first_not_of("0123456789") == string::npos;
+    if(is_port && (adress.size() > 5 || stoi(adress) == 0 || stoi(adress) > 65535)){
+        throw std::runtime_error("Invalid gdb port: " + adress);
+    }
+    if(!is_port && adress.size() >= sizeof(sockaddr_un::sun_path)){
+        throw std::runtime_error("gdb socket path too long: " + adress);
+    }
+    string name = is_port ? "gdb port " + adress : "gdb socket " + adress;
+    this->server = socket(is_port ? AF_INET : AF_UNIX, SOCK_STREAM, 0);
+    if(this->server < 0){
+        throw std::runtime_error("Can't open " + name + ": " + strerror(errno));
+    }
+    int result;
+    if(is_port){
+        int yes = 1;
+        setsockopt(this->server, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(stoi(adress));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK); // only local connections
+        result = bind(this->server, (sockaddr*) &addr, sizeof(addr));
+    } else {
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, adress.c_str());
+        unlink(adress.c_str()); // left over from the last run
+        result = bind(this->server, (sockaddr*) &addr, sizeof(addr));
+    }
+    if(result == 0){
+        result = listen(this->server, 1);
+    }
+    if(result != 0){
+        int error = errno;
+        close(this->server); // the destructor doesn't run for a constructor that throws
+        if(!is_port) unlink(adress.c_str());
+        throw std::runtime_error("Can't open " + name + ": " + strerror(error));
+    }
+    if(!is_port){
+        this->unix_path = adress;
+    }
+    set_nonblocking(this->server);
+    printf("Waiting for gdb on %s\n", adress.c_str());
+}
+
+GdbStub::~GdbStub()
+{
+    disconnect();
+    close(this->server);
+    if(!this->unix_path.empty()){
+        unlink(this->unix_path.c_str());
+    }
+}
+
+void GdbStub::disconnect(){
+    if(this->client >= 0){
+        close(this->client);
+        printf("gdb disconnected\n");
+    }
+    this->client = -1;
+    this->input.clear();
+    this->running = false;
+}
+
+void GdbStub::poll(){
+    if(this->client < 0){
+        int fd = accept(this->server, nullptr, nullptr);
+        if(fd < 0) return; // nobody there, EAGAIN
+        set_nonblocking(fd);
+        int yes = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes)); // fails harmlessly on Unix sockets
+        this->client = fd;
+        this->no_ack = false;
+        this->running = false;
+        this->stop_signal = SIGNAL_TRAP;
+        printf("gdb connected\n");
+        // gdb expects the target to be stopped when it attaches
+        this->debugger.request_break();
+        return;
+    }
+    if(!receive(0)) return;
+
+    // acknowledgements of our last reply don't need an answer
+    size_t start = this->input.find_first_not_of("+-");
+    this->input.erase(0, start == string::npos ? this->input.size() : start);
+    if(this->input.empty()) return;
+    if(this->input[0] == 0x03){
+        this->stop_signal = SIGNAL_INT; // Ctrl-C in gdb
+        this->input.erase(0, 1);
+    }
+    // anything else is a request, which is answered once the machine has stopped
+    this->debugger.request_break();
+}
+
+// reads whatever arrived within timeout_ms, returns false if nothing did
+bool GdbStub::receive(int timeout_ms){
+    pollfd p = {this->client, POLLIN, 0};
+    if(::poll(&p, 1, timeout_ms) <= 0) return false;
+    char buffer[4096];
+    ssize_t n = recv(this->client, buffer, sizeof(buffer), 0);
+    if(n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)){
+        disconnect();
+        return false;
+    }
+    if(n < 0) return false;
+    this->input.append(buffer, n);
+    return true;
+}
+
+// takes the next complete $packet#xx from the input
+bool GdbStub::next_packet(string& packet){
+    while(true){
+        size_t begin = this->input.find('$');
+        if(begin == string::npos){
+            this->input.clear(); // acknowledgements and Ctrl-C while stopped
+            return false;
+        }
+        size_t end = this->input.find('#', begin);
+        if(end == string::npos || end + 2 >= this->input.size()){
+            this->input.erase(0, begin);
+            return false; // not complete yet
+        }
+        packet = this->input.substr(begin+1, end-begin-1);
+        uint8_t checksum = 0;
+        for(char c : packet) checksum += (uint8_t) c;
+        bool valid = this->input.compare(end+1, 2, hex_byte(checksum)) == 0;
+        this->input.erase(0, end+3);
+        if(!this->no_ack){
+            send_raw(valid ? "+" : "-");
+        }
+        if(valid || this->no_ack) return true;
+    }
+}
+
+void GdbStub::send_raw(const string& data){
+    size_t sent = 0;
+    while(this->client >= 0 && sent < data.size()){
+        ssize_t n = send(this->client, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if(n > 0){
+            sent += n;
+        } else if(n < 0 && (errno == EAGAIN || errno == EINTR)){
+            pollfd p = {this->client, POLLOUT, 0};
+            ::poll(&p, 1, 100);
+        } else {
+            disconnect();
+        }
+    }
+}
+
+void GdbStub::send_packet(const string& data){
+    uint8_t checksum = 0;
+    for(char c : data) checksum += (uint8_t) c;
+    send_raw("$" + data + "#" + hex_byte(checksum));
+}
+
+string GdbStub::stop_reply(){
+    if(this->debugger.stop_watch >= 0){
+        char reply[32];
+        const char* kind = this->debugger.stop_watch_write ? "watch" : "rwatch";
+        snprintf(reply, sizeof(reply), "T%02x%s:%x;", SIGNAL_TRAP, kind, this->debugger.stop_watch);
+        return reply;
+    }
+    return "S" + hex_byte(this->stop_signal);
+}
+
+bool GdbStub::wait(){
+    if(this->running){
+        // the step or continue gdb asked for has ended
+        send_packet(stop_reply());
+        this->running = false;
+    }
+    while(this->client >= 0){
+        string packet;
+        while(next_packet(packet)){
+            bool resume = false;
+            bool kill = false;
+            string reply;
+            try {
+                reply = handle(packet, resume, kill);
+            } catch(const std::logic_error& e){ // malformed numbers
+                reply = "E01";
+            }
+            if(kill){
+                disconnect();
+                return false;
+            }
+            if(resume){
+                this->running = this->client >= 0; // not after a detach
+                this->stop_signal = SIGNAL_TRAP;
+                return true;
+            }
+            send_packet(reply);
+        }
+        receive(100);
+    }
+    // gdb went away, the game goes on
+    this->debugger.resume();
+    return true;
+}
+
+string GdbStub::read_registers(){
+    string reply;
+    for(uint8_t r : {this->emu.a, this->emu.b, this->emu.c, this->emu.d, this->emu.e, this->emu.h, this->emu.l}){
+        reply += hex_byte(r);
+    }
+    reply += hex_byte(this->emu.sp & 0xFF) + hex_byte(this->emu.sp >> 8);
+    reply += hex_byte(this->emu.pc & 0xFF) + hex_byte(this->emu.pc >> 8);
+    reply += hex_byte(this->emu.flags);
+    return reply;
+}
+
+// registers are numbered like in read_registers: A B C D E H L SP PC PSW
+void GdbStub::write_register(int number, uint16_t value){
+    uint8_t* bytes[] = {&this->emu.a, &this->emu.b, &this->emu.c, &this->emu.d, &this->emu.e, &this->emu.h, &this->emu.l};
+    if(number < 7){
+        *bytes[number] = value & 0xFF;
+    } else if(number == 7){
+        this->emu.sp = value;
+    } else if(number == 8){
+        this->emu.pc = value;
+    } else if(number == 9){
+        this->emu.flags = (value & (FLAG_S | FLAG_Z | FLAG_AC | FLAG_P | FLAG_CY)) | FLAG_1;
+    } else {
+        throw std::out_of_range("register");
+    }
+}
+
+string GdbStub::handle(const string& packet, bool& resume, bool& kill){
+    static const int REGISTER_SIZE[10]   = {1, 1, 1, 1, 1, 1, 1, 2, 2, 1};
+    static const int REGISTER_OFFSET[10] = {0, 1, 2, 3, 4, 5, 6, 7, 9, 11}; // in bytes
+    uint16_t mask = this->emu.RAM_size-1;
+    char type = packet.empty() ? 0 : packet[0];
+    string args = packet.empty() ? "" : packet.substr(1);
+
+    switch(type){
+        case '?':
+            return stop_reply();
+        case 'g':
+            return read_registers();
+        case 'G':{
+            size_t i = 0;
+            for(int r=0; r<10; r++){
+                uint16_t value = parse_hex_byte(args, i);
+                if(REGISTER_SIZE[r] == 2) value |= parse_hex_byte(args, i+2) << 8;
+                write_register(r, value);
+                i += 2*REGISTER_SIZE[r];
+            }
+            return "OK";
+        }
+        case 'p':{
+            int r = stoi(args, nullptr, 16);
+            if(r < 0 || r > 9) return "E01";
+            return read_registers().substr(2*REGISTER_OFFSET[r], 2*REGISTER_SIZE[r]);
+        }
+        case 'P':{
+            size_t eq = args.find('=');
+            int r = stoi(args.substr(0, eq), nullptr, 16);
+            uint16_t value = parse_hex_byte(args, eq+1);
+            if(args.size() >= eq+5) value |= parse_hex_byte(args, eq+3) << 8; // little endian
+            write_register(r, value);
+            return "OK";
+        }
+        case 'm':{
+            size_t comma = args.find(',');
+            uint16_t adress = stoul(args.substr(0, comma), nullptr, 16);
+            size_t length = min((size_t) stoul(args.substr(comma+1), nullptr, 16), MAX_MEMORY_READ);
+            string reply;
+            for(size_t i=0; i<length; i++){
+                reply += hex_byte(this->emu.memory[(adress+i) & mask]);
+            }
+            return reply;
+        }
+        case 'M':{
+            // writes go straight to memory, so ROM can be patched too
+            size_t comma = args.find(',');
+            size_t colon = args.find(':');
+            uint16_t adress = stoul(args.substr(0, comma), nullptr, 16);
+            size_t length = stoul(args.substr(comma+1, colon-comma-1), nullptr, 16);
+            for(size_t i=0; i<length; i++){
+                this->emu.memory[(adress+i) & mask] = parse_hex_byte(args, colon+1+2*i);
+            }
+            if(this->emu.hashing) this->emu.rehash();
+            this->emu.forget_superinstructions(0, this->emu.RAM_size); // the adresses may wrap around
+            return "OK";
+        }
+        case 'c':
+        case 's':
+            if(!args.empty()){
+                this->emu.pc = stoul(args, nullptr, 16);
+            }
+            if(type == 'c'){
+                this->debugger.resume();
+            } else {
+                this->debugger.step(1);
+            }
+            resume = true;
+            return "";
+        case 'Z':
+        case 'z':{
+            // Z0/Z1 breakpoint, Z2 write, Z3 read, Z4 access watchpoint: Ztype,adress,length
+            bool insert = type == 'Z';
+            int kind = args[0] - '0';
+            size_t comma = args.find(',', 2);
+            uint16_t adress = stoul(args.substr(2, comma-2), nullptr, 16);
+            int length = max(1, stoi(args.substr(comma+1), nullptr, 16));
+            if(kind == 0 || kind == 1){
+                this->debugger.set_breakpoint(adress, insert);
+                return "OK";
+            }
+            static const uint8_t WATCH_KIND[5] = {0, 0, WATCH_WRITE, WATCH_READ, WATCH_READ | WATCH_WRITE};
+            if(kind > 4) return "";
+            for(int i=0; i<length; i++){
+                uint8_t bits = this->debugger.watchpoint(adress+i);
+                bits = insert ? (bits | WATCH_KIND[kind]) : (bits & ~WATCH_KIND[kind]);
+                this->debugger.set_watchpoint(adress+i, bits);
+            }
+            return "OK";
+        }
+        case 'D':
+            send_packet("OK");
+            disconnect();
+            this->debugger.resume();
+            resume = true;
+            return "";
+        case 'k':
+            kill = true;
+            return "";
+        case 'H':
+            return "OK"; // there is only one thread
+        case 'q':
+            if(packet.rfind("qSupported", 0) == 0) return "PacketSize=1000;QStartNoAckMode+";
+            if(packet == "qAttached") return "1";
+            if(packet == "qC") return "QC1";
+            return "";
+        case 'Q':
+            if(packet == "QStartNoAckMode"){
+                this->no_ack = true;
+                return "OK";
+            }
+            return "";
+    }
+    return ""; // not supported
+}
+
+#endif // ENABLE_DEBUGGER
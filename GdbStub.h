@@ -0,0 +1,55 @@
+#ifndef GDBSTUB_H
+#define GDBSTUB_H
+
+#ifdef ENABLE_DEBUGGER
+
+#include "Emulator.h"
+#include "Debugger.h"
+#include <string>
+
+using namespace std;
+
+// This class serves the GDB remote serial protocol on a local TCP port or Unix socket,
+// so that gdb or scripts can control the running machine. While the game runs the socket
+// is only polled once per frame without blocking. When a breakpoint, a step or an
+// interrupt from gdb stops the emulation, wait() serves requests until gdb continues.
+// The registers are sent in this order: A B C D E H L (1 byte), SP PC (2 bytes, little
+// endian) and PSW (the flags byte).
+
+class GdbStub
+{
+    public:
+        // a number is a TCP port on localhost, anything else the path of a Unix socket
+        GdbStub(Emulator& emu, Debugger& debugger, const string& adress);
+        virtual ~GdbStub();
+
+        void poll();            // once per frame: accept gdb, notice Ctrl-C and new requests
+        bool connected() const { return this->client >= 0; }
+        bool wait();            // serve gdb while stopped, returns false if gdb killed the machine
+
+    private:
+        Emulator& emu;
+        Debugger& debugger;
+        string unix_path;       // removed again when closing
+
+        int server = -1;        // listening socket
+        int client = -1;        // connection to gdb, -1 = none
+        bool no_ack = false;    // QStartNoAckMode
+        bool running = false;   // gdb waits for a stop reply
+        int stop_signal = 5;    // SIGTRAP, or SIGINT after Ctrl-C
+        string input;           // received bytes that aren't a complete packet yet
+
+        void disconnect();
+        bool receive(int timeout_ms);
+        bool next_packet(string& packet);
+        void send_packet(const string& data);
+        void send_raw(const string& data);
+        string stop_reply();
+        string handle(const string& packet, bool& resume, bool& kill);
+        string read_registers();
+        void write_register(int number, uint16_t value);
+};
+
+#endif // ENABLE_DEBUGGER
+
+#endif // GDBSTUB_H
@@ -0,0 +1,103 @@
+#include "HashLog.h"
+#include <map>
+#include <vector>
+#include <stdexcept>
+
+HashLog::HashLog(const string& filename)
+{
+    this->fp = fopen(filename.c_str(), "w");
+    if(this->fp == NULL){
+        throw std::runtime_error("Can not write hash log: " + filename);
+    }
+}
+
+HashLog::~HashLog()
+{
+    fclose(this->fp);
+}
+
+void HashLog::frame(uint64_t frame, uint64_t hash){
+    fprintf(this->fp, "frame %llu %016llx\n", (unsigned long long) frame, (unsigned long long) hash);
+}
+
+void HashLog::instruction(uint64_t number, uint16_t pc, uint64_t hash){
+    fprintf(this->fp, "instruction %llu %04x %016llx\n", (unsigned long long) number, pc, (unsigned long long) hash);
+}
+
+struct LoggedInstruction {
+    uint16_t pc;
+    unsigned long long hash;
+};
+
+struct LoggedFrame {
+    unsigned long long hash;
+    vector<LoggedInstruction> instructions;
+};
+
+static map<uint64_t, LoggedFrame> load(const string& filename){
+    FILE* fp = fopen(filename.c_str(), "r");
+    if(fp == NULL){
+        throw std::runtime_error("Hash log not found: " + filename);
+    }
+    map<uint64_t, LoggedFrame> frames;
+    vector<LoggedInstruction> instructions; // of the frame whose line comes next
+    char line[128];
+    while(fgets(line, sizeof(line), fp)){
+        unsigned long long number, hash;
+        unsigned int pc;
+        if(sscanf(line, "instruction %llu %x %llx", &number, &pc, &hash) == 3){
+            if(number == 0) instructions.clear();
+            instructions.push_back({(uint16_t) pc, hash});
+        } else if(sscanf(line, "frame %llu %llx", &number, &hash) == 2){
+            frames[number] = {hash, instructions};
+            instructions.clear();
+        }
+    }
+    fclose(fp);
+    return frames;
+}
+
+int HashLog::bisect(const string& filename_a, const string& filename_b){
+    map<uint64_t, LoggedFrame> a = load(filename_a);
+    map<uint64_t, LoggedFrame> b = load(filename_b);
+    uint64_t compared = 0;
+    for(auto& entry : a){
+        auto other = b.find(entry.first);
+        if(other == b.end()) continue;
+        compared++;
+        const LoggedFrame& fa = entry.second;
+        const LoggedFrame& fb = other->second;
+        if(fa.hash == fb.hash) continue;
+
+        printf("The state differs at the end of frame %llu.\n", (unsigned long long) entry.first);
+        if(fa.instructions.empty() || fb.instructions.empty()){
+            printf("Run both again with --hash-frame %llu to find the instruction.\n", (unsigned long long) entry.first);
+            return 1;
+        }
+        size_t n = min(fa.instructions.size(), fb.instructions.size());
+        for(size_t i=0; i<n; i++){
+            const LoggedInstruction& ia = fa.instructions[i];
+            const LoggedInstruction& ib = fb.instructions[i];
+            if(i == 0 && ia.hash != ib.hash){
+                // the frame before ended the same, so this instruction is the first suspect
+                printf("First difference after instruction 0 of the frame: PC %04x in %s, %04x in %s.\n",
+                    ia.pc, filename_a.c_str(), ib.pc, filename_b.c_str());
+                printf("If the runs had different inputs for this frame, those may differ instead.\n");
+                return 1;
+            }
+            if(ia.hash != ib.hash || ia.pc != ib.pc){
+                printf("First difference after instruction %zu of the frame: PC %04x in %s, %04x in %s.\n",
+                    i, ia.pc, filename_a.c_str(), ib.pc, filename_b.c_str());
+                if(i > 0){
+                    printf("The instruction before was at %04x in both.\n", fa.instructions[i-1].pc);
+                }
+                return 1;
+            }
+        }
+        printf("The instructions of the frame are the same, %zu and %zu were run: the difference comes from outside the CPU "
+               "(interrupts or ports).\n", fa.instructions.size(), fb.instructions.size());
+        return 1;
+    }
+    printf("No difference in the %llu frames of both logs.\n", (unsigned long long) compared);
+    return 0;
+}
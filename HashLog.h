@@ -0,0 +1,34 @@
+#ifndef HASHLOG_H
+#define HASHLOG_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+using namespace std;
+
+// This class writes the state hash of every frame to a text file (--hash-log), and for one
+// frame (--hash-frame) also the hash after every instruction. Two runs that should behave
+// the same, e.g. a replay on two builds or dispatch engines, are compared with bisect()
+// (--bisect), which names the first frame that differs and, if both logs have the
+// instructions of that frame, the first instruction.
+// Lines: "frame N HASH" and "instruction N PC HASH" for the instructions of the frame
+// that follows. A frame that is run again (netplay rollback) counts with its last line.
+
+class HashLog
+{
+    public:
+        HashLog(const string& filename);
+        virtual ~HashLog();
+
+        void frame(uint64_t frame, uint64_t hash);
+        void instruction(uint64_t number, uint16_t pc, uint64_t hash);
+
+        // prints where the logs differ, returns 0 if they don't
+        static int bisect(const string& filename_a, const string& filename_b);
+
+    private:
+        FILE* fp;
+};
+
+#endif // HASHLOG_H
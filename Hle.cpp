@@ -0,0 +1,189 @@
+#include "Hle.h"
+#include <stdio.h>
+#include <string.h>
+
+static const uint64_t RET_CYCLES = 10;
+static const uint64_t MAX_VALIDATION_STEPS = 1 << 24; // a routine that takes longer never returns
+static const uint64_t CLEAR_SCREEN_CYCLES = 10 + (uint64_t) (0x4000 - 0x2400) * (10 + 5 + 5 + 7 + 10);
+
+Hle::Hle(Emulator& emu, bool validate)
+    : validate(validate)
+{
+    // the routines of the Space Invaders ROM, named like in the ComputerArcheology disassembly
+    this->hooks = {
+        {"BlockCopy",      0x1A32, {0x1A, 0x77, 0x23, 0x13, 0x05, 0xC2, 0x32, 0x1A, 0xC9}, block_copy, 0},
+        {"DrawSimpSprite", 0x15D3, {0xC5, 0x1A, 0x77, 0x13, 0x01, 0x20, 0x00, 0x09, 0xC1, 0x05, 0xC2, 0xD3, 0x15, 0xC9},
+                           draw_simple_sprite, 0},
+        {"ClearScreen",    0x1A5C, {0x21, 0x00, 0x24, 0x36, 0x00, 0x23, 0x7C, 0xFE, 0x40, 0xC2, 0x5F, 0x1A, 0xC9},
+                           clear_screen, CLEAR_SCREEN_CYCLES},
+    };
+
+    this->index = make_unique<int16_t[]>(0x10000);
+    for(int i=0; i<0x10000; i++){
+        this->index[i] = -1;
+    }
+    for(size_t i=0; i<this->hooks.size(); i++){
+        Hook& hook = this->hooks[i];
+        hook.enabled = true;
+        for(size_t j=0; j<hook.signature.size(); j++){
+            if(emu.memory[(hook.adress + j) & (emu.RAM_size-1)] != hook.signature[j]){
+                hook.enabled = false;
+            }
+        }
+        if(hook.enabled){
+            this->index[hook.adress] = i;
+        } else {
+            printf("HLE: %s at %04x disabled, the ROM differs\n", hook.name, hook.adress);
+        }
+    }
+}
+
+Hle::~Hle()
+{
+}
+
+void Hle::print_statistics() const{
+    for(const Hook& hook : this->hooks){
+        printf("HLE: %-16s %04x %12llu calls", hook.name, hook.adress, (unsigned long long) hook.calls);
+        if(hook.rom_calls){
+            printf(", %llu left to the ROM", (unsigned long long) hook.rom_calls);
+        }
+        if(this->validate){
+            printf(", %llu differed from the ROM", (unsigned long long) hook.mismatches);
+        }
+        printf("%s\n", hook.enabled ? "" : " (disabled)");
+    }
+}
+
+void Hle::run(Emulator& emu, Hook& hook){
+    if(!hook.enabled) return;
+    // the Machine only takes interrupts between steps, so a routine of several frames in
+    // one step would make it drop them. fuse_limit is the next interrupt, 0 if unknown
+    if(hook.long_cycles && emu.interrupt_enabled && emu.cycles + hook.long_cycles + RET_CYCLES >= emu.fuse_limit){
+        hook.rom_calls++;
+        return;
+    }
+    hook.calls++;
+    if(!this->validate){
+        emu.cycles += hook.native(emu) + RET_CYCLES;
+        emu.ret();
+        return;
+    }
+
+    // run the ROM routine on a copy until it returns to the caller
+    if(!this->scratch){
+        this->scratch = make_unique<Emulator>(emu.RAM_size, emu.ROM_size);
+    }
+    Emulator& rom = *this->scratch;
+    rom.copy_state_from(emu);
+    uint16_t return_sp = rom.sp + 2;
+    uint16_t return_pc = rom.read_memory(rom.sp) | (rom.read_memory(rom.sp+1) << 8);
+    for(uint64_t steps=0; steps<MAX_VALIDATION_STEPS; steps++){
+        rom.execute_next_instruction();
+        if(rom.pc == return_pc && rom.sp == return_sp) break;
+    }
+
+    emu.cycles += hook.native(emu) + RET_CYCLES;
+    emu.ret();
+
+    if(!compare(emu, rom, hook)){
+        // keep the result of the ROM and don't use this hook any more
+        hook.mismatches++;
+        hook.enabled = false;
+        this->index[hook.adress] = -1;
+        emu.copy_state_from(rom);
+    }
+}
+
+bool Hle::compare(const Emulator& native, const Emulator& rom, const Hook& hook) const{
+    if(native.a != rom.a || native.b != rom.b || native.c != rom.c || native.d != rom.d || native.e != rom.e ||
+       native.h != rom.h || native.l != rom.l || native.sp != rom.sp || native.pc != rom.pc ||
+       native.flags != rom.flags || native.cycles != rom.cycles){
+        printf("HLE: %s differs from the ROM\n", hook.name);
+        for(const Emulator* e : {&native, &rom}){
+            printf("  %-6s PC %04X SP %04X A %02X B %02X C %02X D %02X E %02X H %02X L %02X flags %02X cycles %llu\n",
+                e == &native ? "native" : "ROM", e->pc, e->sp, e->a, e->b, e->c, e->d, e->e, e->h, e->l, e->flags,
+                (unsigned long long) e->cycles);
+        }
+        return false;
+    }
+    if(memcmp(native.memory.get(), rom.memory.get(), native.RAM_size) != 0){
+        for(unsigned int i=0; i<native.RAM_size; i++){
+            if(native.memory[i] != rom.memory[i]){
+                printf("HLE: %s differs from the ROM at %04x: native %02x, ROM %02x\n", hook.name, i,
+                    native.memory[i], rom.memory[i]);
+                break;
+            }
+        }
+        return false;
+    }
+    return true;
+}
+
+// 1A32 BlockCopy: copies B bytes (0 = 256) from DE to HL
+//   LDAX D; MOV M,A; INX H; INX D; DCR B; JNZ 1A32
+uint64_t Hle::block_copy(Emulator& emu){
+    uint64_t cycles = 0;
+    uint16_t hl = (emu.h << 8) | emu.l;
+    uint16_t de = (emu.d << 8) | emu.e;
+    do {
+        emu.a = emu.read_memory(de);
+        emu.write_memory(hl, emu.a);
+        hl++;
+        de++;
+        emu.b = emu.dcr(emu.b);
+        cycles += 7 + 7 + 5 + 5 + 5 + 10;
+    } while(emu.b != 0);
+    emu.h = hl >> 8;
+    emu.l = hl & 0xFF;
+    emu.d = de >> 8;
+    emu.e = de & 0xFF;
+    return cycles;
+}
+
+// 15D3 DrawSimpSprite: draws B bytes from DE, one per screen line of 32 bytes from HL on
+//   PUSH B; LDAX D; MOV M,A; INX D; LXI B,0020; DAD B; POP B; DCR B; JNZ 15D3
+uint64_t Hle::draw_simple_sprite(Emulator& emu){
+    uint64_t cycles = 0;
+    uint16_t hl = (emu.h << 8) | emu.l;
+    uint16_t de = (emu.d << 8) | emu.e;
+    uint16_t sp = emu.sp - 2; // PUSH B leaves B and C below the stack
+    do {
+        emu.write_memory(sp+1, emu.b);
+        emu.write_memory(sp, emu.c);
+        emu.a = emu.read_memory(de);
+        emu.write_memory(hl, emu.a);
+        de++;
+        emu.set_carry(hl + 0x20 > 0xFFFF);
+        hl += 0x20;
+        emu.c = emu.read_memory(sp);
+        emu.b = emu.read_memory(sp+1);
+        emu.b = emu.dcr(emu.b);
+        cycles += 11 + 7 + 7 + 5 + 10 + 10 + 10 + 5 + 10;
+    } while(emu.b != 0);
+    emu.h = hl >> 8;
+    emu.l = hl & 0xFF;
+    emu.d = de >> 8;
+    emu.e = de & 0xFF;
+    return cycles;
+}
+
+// 1A5C ClearScreen: clears the video RAM 2400-3FFF
+//   LXI H,2400; MVI M,0; INX H; MOV A,H; CPI 40; JNZ 1A5F
+uint64_t Hle::clear_screen(Emulator& emu){
+    const uint16_t begin = 0x2400;
+    const uint16_t end = 0x4000;
+    if(emu.ROM_size <= begin && emu.RAM_size >= end && !emu.hashing){
+        memset(emu.memory.get() + begin, 0, end - begin);
+        emu.forget_superinstructions(begin, end);
+    } else {
+        for(uint32_t adress=begin; adress<end; adress++){
+            emu.write_memory(adress, 0);
+        }
+    }
+    emu.h = end >> 8;
+    emu.l = end & 0xFF;
+    emu.a = emu.h;
+    emu.sub(0x40, 0); // flags of the last CPI
+    return CLEAR_SCREEN_CYCLES;
+}
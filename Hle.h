@@ -0,0 +1,60 @@
+#ifndef HLE_H
+#define HLE_H
+
+#include "Emulator.h"
+#include <stdint.h>
+#include <vector>
+#include <memory>
+
+using namespace std;
+
+// This class replaces hot ROM routines with native C++ versions (--hle), an opt-in turbo
+// mode for batch runs without a window. When the CPU calls a hooked adress, the native
+// version changes registers, flags, memory and the cycle count exactly like the ROM
+// routine and returns to the caller. A hook is only enabled if the ROM contains the
+// bytes it was written for, so other boards and ROM versions keep running the ROM code.
+// Interrupts that would happen inside a hooked routine are taken after it returns. A routine
+// that runs longer than a frame (ClearScreen) is only replaced while interrupts are disabled
+// or if it ends before the next interrupt is due, otherwise the ROM code runs.
+// With validate (--hle-validate) every call also runs the ROM routine on a copy of the
+// CPU and compares both, a hook that differs is disabled and the ROM result is kept.
+
+class Hle
+{
+    public:
+        Hle(Emulator& emu, bool validate = false);
+        virtual ~Hle();
+
+        // called by the CPU after a CALL or RST jumped to adress
+        void call(Emulator& emu, uint16_t adress){
+            if(this->index[adress] >= 0) run(emu, this->hooks[this->index[adress]]);
+        }
+        void print_statistics() const;
+
+    private:
+        struct Hook {
+            const char* name;
+            uint16_t adress;
+            vector<uint8_t> signature;    // ROM bytes at adress the native version was written for
+            uint64_t (*native)(Emulator&); // does the routine up to its RET, returns the cycles
+            uint64_t long_cycles;          // of a routine longer than a frame, 0 = short
+            bool enabled = false;
+            uint64_t calls = 0;
+            uint64_t mismatches = 0;
+            uint64_t rom_calls = 0;        // left to the ROM, an interrupt was due before the end
+        };
+
+        vector<Hook> hooks;
+        unique_ptr<int16_t[]> index; // hook of every adress, -1 = none
+        bool validate;
+        unique_ptr<Emulator> scratch; // runs the ROM routine while validating
+
+        void run(Emulator& emu, Hook& hook);
+        bool compare(const Emulator& native, const Emulator& rom, const Hook& hook) const;
+
+        static uint64_t block_copy(Emulator& emu);
+        static uint64_t draw_simple_sprite(Emulator& emu);
+        static uint64_t clear_screen(Emulator& emu);
+};
+
+#endif // HLE_H
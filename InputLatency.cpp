@@ -0,0 +1,97 @@
+#include "InputLatency.h"
+#include <string.h>
+#include <stdio.h>
+#include <string>
+
+InputLatency::InputLatency()
+{
+}
+
+InputLatency::~InputLatency()
+{
+}
+
+void InputLatency::Histogram::add(uint64_t ns){
+    int bucket = 0;
+    for(uint64_t ms = ns / 1000000; ms > 0 && bucket < BUCKETS-1; ms >>= 1){
+        bucket++;
+    }
+    this->buckets[bucket]++;
+    this->count++;
+    this->total_ns += ns;
+    if(ns > this->max_ns) this->max_ns = ns;
+}
+
+void InputLatency::Histogram::print(const char* name) const{
+    if(this->count == 0){
+        printf("%-8s no key presses\n", name);
+        return;
+    }
+    printf("%-8s %6llu presses, mean %7.2f ms, max %7.2f ms\n", name, (unsigned long long) this->count,
+        this->total_ns / 1e6 / this->count, this->max_ns / 1e6);
+    for(int i=0; i<BUCKETS; i++){
+        if(this->buckets[i] == 0) continue;
+        char range[32];
+        if(i == BUCKETS-1){
+            snprintf(range, sizeof(range), ">= %d ms", 1 << (i-1));
+        } else {
+            snprintf(range, sizeof(range), "< %d ms", 1 << i);
+        }
+        int bar = (int) (40 * this->buckets[i] / this->count);
+        printf("  %-10s %6llu %s\n", range, (unsigned long long) this->buckets[i], string(bar, '#').c_str());
+    }
+}
+
+void InputLatency::key_down(int port, uint8_t bit, uint32_t queued_ms){
+    clock::time_point now = clock::now();
+    if(this->stage == STAGE_READ && now - this->handled > std::chrono::seconds(2)){
+        this->dropped++; // the game never saw it
+        this->stage = STAGE_IDLE;
+    }
+    if(this->stage != STAGE_IDLE){
+        this->skipped++;
+        return;
+    }
+    this->stage = STAGE_READ;
+    this->port = port;
+    this->bit = bit;
+    this->handled = now;
+    this->queued_ns = (uint64_t) queued_ms * 1000000;
+}
+
+void InputLatency::port_read(int port, uint8_t value, const uint8_t* vram){
+    if(port != this->port || !(value & this->bit)) return;
+    this->read = clock::now();
+    memcpy(this->vram, vram, VRAM_SIZE);
+    this->stage = STAGE_VRAM;
+}
+
+void InputLatency::frame_done(const uint8_t* vram){
+    if(this->stage != STAGE_VRAM || memcmp(this->vram, vram, VRAM_SIZE) == 0) return;
+    this->changed = clock::now();
+    this->stage = STAGE_PRESENT;
+}
+
+void InputLatency::presented(){
+    if(this->stage != STAGE_PRESENT) return;
+    clock::time_point now = clock::now();
+    this->poll_stage.add(this->queued_ns);
+    this->read_stage.add(ns(this->read - this->handled));
+    this->vram_stage.add(ns(this->changed - this->read));
+    this->present_stage.add(ns(now - this->changed));
+    this->total.add(this->queued_ns + ns(now - this->handled));
+    this->stage = STAGE_IDLE;
+}
+
+void InputLatency::print_statistics() const{
+    printf("Input latency from the key press to the screen, by stage:\n");
+    this->poll_stage.print("poll");
+    this->read_stage.print("read");
+    this->vram_stage.print("vram");
+    this->present_stage.print("present");
+    this->total.print("total");
+    if(this->skipped || this->dropped){
+        printf("%llu presses came while one was measured, %llu were never read by the game\n",
+            (unsigned long long) this->skipped, (unsigned long long) this->dropped);
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef INPUTLATENCY_H
+#define INPUTLATENCY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <chrono>
+
+using namespace std;
+
+// This class measures where the time goes between a key press and the picture that shows
+// it (--latency-stats). A press that sets a port bit is followed through four stages:
+//   poll     SDL queued the event until Machine::run handled it
+//   read     until the game read the port with IN and saw the new bit
+//   vram     until the video RAM changed after that read (checked after every frame)
+//   present  until the next SDL_RenderPresent returned
+// Only one press is followed at a time, presses during it are counted as skipped. A press
+// the game doesn't read within two seconds (e.g. overridden by --replay) is dropped.
+// With --run-ahead the read and vram stages follow the frames run ahead, whose last one is
+// shown, and the real frame before them is left out.
+
+class InputLatency
+{
+    public:
+        InputLatency();
+        virtual ~InputLatency();
+
+        // a key down set the bit of the port, SDL queued it queued_ms before
+        void key_down(int port, uint8_t bit, uint32_t queued_ms);
+        bool waiting_for_read() const { return this->stage == STAGE_READ; }
+        void port_read(int port, uint8_t value, const uint8_t* vram); // IN 0, 1 or 2
+        void frame_done(const uint8_t* vram);
+        void presented();
+        void print_statistics() const;
+
+    private:
+        using clock = std::chrono::steady_clock;
+        static const size_t VRAM_SIZE = 0x1C00;
+
+        enum Stage { STAGE_IDLE, STAGE_READ, STAGE_VRAM, STAGE_PRESENT };
+
+        // latencies in buckets of powers of two milliseconds
+        struct Histogram {
+            static const int BUCKETS = 10; // < 1 ms, < 2 ms, ... < 256 ms, more
+            uint64_t buckets[BUCKETS] = {};
+            uint64_t count = 0;
+            uint64_t total_ns = 0;
+            uint64_t max_ns = 0;
+            void add(uint64_t ns);
+            void print(const char* name) const;
+        };
+
+        Stage stage = STAGE_IDLE;
+        int port = 0;
+        uint8_t bit = 0;
+        clock::time_point handled;  // the times the press reached each stage
+        clock::time_point read;
+        clock::time_point changed;
+        uint64_t queued_ns = 0;
+        uint8_t vram[VRAM_SIZE];    // when the port was read
+
+        Histogram poll_stage, read_stage, vram_stage, present_stage, total;
+        uint64_t skipped = 0;
+        uint64_t dropped = 0;
+
+        static uint64_t ns(clock::duration d) { return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count(); }
+};
+
+#endif // INPUTLATENCY_H
@@ -0,0 +1,53 @@
+#include "InputLog.h"
+#include <stdio.h>
+#include <stdexcept>
+
+InputLog::InputLog()
+{
+}
+
+InputLog::~InputLog()
+{
+}
+
+void InputLog::load(const string& filename){
+    FILE * fp = fopen(filename.c_str(), "rb");
+    if(fp==NULL){
+        throw std::runtime_error("Input recording not found: " + filename);
+    }
+    this->frames.clear();
+    uint8_t bytes[3];
+    while(fread(bytes, 1, 3, fp) == 3){
+        this->frames.push_back({bytes[0], bytes[1], bytes[2]});
+    }
+    fclose(fp);
+}
+
+void InputLog::save(const string& filename) const{
+    FILE * fp = fopen(filename.c_str(), "wb");
+    if(fp==NULL){
+        throw std::runtime_error("Can not write input recording: " + filename);
+    }
+    for(const FrameInput& input : this->frames){
+        uint8_t bytes[3] = {input.port0, input.port1, input.port2};
+        fwrite(bytes, 1, 3, fp);
+    }
+    fclose(fp);
+}
+
+InputLog InputLog::demo(const FrameInput& idle, size_t frames){
+    InputLog log;
+    for(size_t frame=0; frame<frames; frame++){
+        FrameInput input = idle;
+        if(frame >= 120 && frame < 130) input.port1 ^= 0x01; // coin
+        if(frame >= 180 && frame < 190) input.port1 |= 0x04; // 1 player start
+        if(frame >= 300){
+            // sweep left and right, firing every half second
+            size_t t = frame - 300;
+            input.port1 |= ((t / 90) % 2) ? 0x40 : 0x20;
+            if(t % 30 < 5) input.port1 |= 0x10;
+        }
+        log.append(input);
+    }
+    return log;
+}
@@ -0,0 +1,42 @@
+#ifndef INPUTLOG_H
+#define INPUTLOG_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// value of the three input ports during one frame
+struct FrameInput {
+    uint8_t port0;
+    uint8_t port1;
+    uint8_t port2;
+};
+
+// This class holds the inputs of every frame of a session, so that it can be
+// recorded (--record) and played back exactly (--replay). The file format is
+// three bytes per frame, the values of input port 0, 1 and 2.
+
+class InputLog
+{
+    public:
+        InputLog();
+        virtual ~InputLog();
+
+        void load(const string& filename);
+        void save(const string& filename) const;
+
+        void append(const FrameInput& input) { this->frames.push_back(input); }
+        const FrameInput& operator[](size_t frame) const { return this->frames[frame]; }
+        size_t size() const { return this->frames.size(); }
+        void truncate(size_t frames) { if(frames < this->frames.size()) this->frames.resize(frames); }
+
+        // a scripted session: insert coin, start a 1 player game, move around and shoot
+        static InputLog demo(const FrameInput& idle, size_t frames);
+
+    private:
+        vector<FrameInput> frames;
+};
+
+#endif // INPUTLOG_H
@@ -1,19 +1,118 @@
 #include "Machine.h"
+#include <stdexcept>
+#include <string.h>
 
-Machine::Machine(const std::string& filename)
+Machine::Machine(const MachineOptions& options)
+    : scaler(options.scale, options.scanlines, options.overlay && BoardProfile::find(options.board).overlay),
+#ifdef ENABLE_DEBUGGER
+      debugger(this->emu),
+#endif
+      options(options), board(BoardProfile::find(options.board))
 {
-    // if ROM is provided as invaders.e, invaders.h, ...
-    if(filename.back() == '.'){
-        string endings = "hgfe"; // standard file endings are "little endian"
-        for(int i=0; i<4;i++){
-            emu.load_program_from_file(filename+endings[i],0x0800*i);
-        }
-    } else {
-        emu.load_program_from_file(filename);
+    load_roms();
+
+    // wire up the ports
+    const PortMap& p = this->board.ports;
+    for(int i=0; i<256; i++){
+        this->in_ports[i]  = PORT_NONE;
+        this->out_ports[i] = PORT_NONE;
     }
+    this->in_ports[p.input0]        = PORT_INPUT0;
+    this->in_ports[p.input1]        = PORT_INPUT1;
+    this->in_ports[p.input2]        = PORT_INPUT2;
+    this->in_ports[p.shift_result]  = PORT_SHIFT_RESULT;
+    this->out_ports[p.shift_amount] = PORT_SHIFT_AMOUNT;
+    this->out_ports[p.shift_data]   = PORT_SHIFT_DATA;
+    this->out_ports[p.sound1]       = PORT_SOUND;
+    this->out_ports[p.sound2]       = PORT_SOUND;
+    this->out_ports[p.watchdog]     = PORT_WATCHDOG;
 
-    int n = this->screen_width * this->screen_height;
+    this->out_port0 = this->board.port0;
+    this->out_port1 = this->board.port1;
+    this->out_port2 = this->board.port2;
+    if(options.dip_switches >= 0){
+        this->out_port2 = (this->out_port2 & ~this->board.dip_mask) | (options.dip_switches & this->board.dip_mask);
+    }
+
+    int n = this->scaler.width() * this->scaler.height();
     this->textureBuffer = make_unique<uint32_t[]>(n);
+    if(options.scale > 1){
+        // the picture is already scaled, the renderer only copies it
+        this->window_width  = this->scaler.width();
+        this->window_height = this->scaler.height();
+    }
+
+    if(!options.replay_file.empty()){
+        this->replay_log.load(options.replay_file);
+    }
+    if(!options.nvram_file.empty()){
+        if(this->board.nvram.empty()){
+            throw std::runtime_error("Board profile " + this->board.name + " has no NVRAM ranges");
+        }
+        this->nvram = make_unique<NvramStore>(options.nvram_file, this->board.nvram);
+    }
+    if(!options.capture_file.empty()){
+        this->capture = make_unique<VideoCapture>(options.capture_file, options.overlay && this->board.overlay);
+    }
+    if(!options.hash_log.empty()){
+        this->hash_log = make_unique<HashLog>(options.hash_log);
+    }
+    if(this->hash_log || options.netplay_player){
+        this->emu.enable_hashing();
+    }
+    if(options.fusion){
+        this->emu.enable_superinstructions();
+    }
+    if(options.netplay_player){
+        // a rollback can't take back what was written to these files
+        if(this->nvram || this->capture){
+            throw std::runtime_error("--netplay can't be combined with --nvram or --capture");
+        }
+        this->netplay = make_unique<Netplay>(options.netplay_player, options.netplay_port, current_input());
+        this->snapshots = make_unique<MachineState[]>(Netplay::MAX_ROLLBACK + 1);
+        this->netplay->connect();
+    }
+    if(!options.metrics_file.empty()){
+        this->metrics = make_unique<Metrics>(options.metrics_file);
+    }
+    if(!options.trace_file.empty()){
+        this->trace = make_unique<Trace>(options.trace_file);
+        this->trace->name_thread("emulation");
+    }
+    if(options.run_ahead < 0 || options.run_ahead > 8){
+        throw std::runtime_error("--run-ahead has to be between 0 and 8 frames");
+    }
+    if(options.run_ahead > 0){
+        if(this->netplay){
+            throw std::runtime_error("--run-ahead can't be combined with --netplay, which has its own rollback");
+        }
+        this->ahead_state = make_unique<MachineState>();
+        this->ahead_vram = make_unique<uint8_t[]>(VramView::size);
+    }
+    if(options.hle || options.hle_validate){
+        this->hle = make_unique<Hle>(this->emu, options.hle_validate);
+        this->emu.hle = this->hle.get();
+    }
+    if(!options.symbol_file.empty()){
+        this->symbols.load(options.symbol_file);
+    }
+    if(!options.profile_file.empty()){
+        this->profiler = make_unique<Profiler>(this->emu, this->symbols);
+        this->emu.profiler = this->profiler.get();
+    }
+#ifdef ENABLE_DEBUGGER
+    this->debugger.set_symbols(&this->symbols);
+    if(options.debug){
+        this->debugger.request_break();
+    }
+    if(!options.gdb.empty()){
+        this->gdb = make_unique<GdbStub>(this->emu, this->debugger, options.gdb);
+    }
+#endif
+    if(options.headless) return;
+    if(options.latency_stats){
+        this->latency = make_unique<InputLatency>();
+    }
 
     if (SDL_Init(SDL_INIT_EVERYTHING) != 0) {
         printf("error initializing SDL: %s\n", SDL_GetError());
@@ -24,15 +123,49 @@ Machine::Machine(const std::string& filename)
                                        SDL_WINDOWPOS_CENTERED,
                                        this->window_width, this->window_height, 0);
 
+    uint32_t renderer_flags = options.software_renderer ? SDL_RENDERER_SOFTWARE : SDL_RENDERER_ACCELERATED;
     this->renderer = SDL_CreateRenderer(this->win, -1,
-        SDL_RENDERER_ACCELERATED | SDL_RENDERER_TARGETTEXTURE);
+        renderer_flags | SDL_RENDERER_TARGETTEXTURE);
 
     this->texture = SDL_CreateTexture( this->renderer,
-        SDL_PIXELFORMAT_RGB888, SDL_TEXTUREACCESS_STREAMING, this->screen_height, this->screen_width );
+        SDL_PIXELFORMAT_RGB888, SDL_TEXTUREACCESS_STREAMING, this->scaler.width(), this->scaler.height() );
+}
+
+void Machine::load_roms(){
+    // the image is cached, only the first Machine of a board reads the files
+    this->rom = RomLoader::load(this->board, this->options.ignore_crc);
+    this->emu.load_program(this->rom->data, sizeof(this->rom->data));
 }
 
 Machine::~Machine()
 {
+    if(this->netplay){
+        netplay_finish();
+        this->netplay->print_statistics();
+    }
+    if(!this->options.record_file.empty()){
+        // a destructor must not throw, that would end the process without a message
+        try {
+            this->recording_log.save(this->options.record_file);
+        } catch(std::exception& e){
+            fprintf(stderr, "%s\n", e.what());
+        }
+    }
+    if(this->profiler){
+        try {
+            this->profiler->save(this->options.profile_file);
+        } catch(std::exception& e){
+            fprintf(stderr, "%s\n", e.what());
+        }
+        this->emu.profiler = nullptr;
+    }
+    if(this->hle && this->options.hle_validate){
+        this->hle->print_statistics();
+    }
+    if(this->latency){
+        this->latency->print_statistics();
+    }
+    if(this->options.headless) return;
     SDL_DestroyRenderer(this->renderer);
     //delete this->textureBuffer;
 }
@@ -87,6 +220,18 @@ void Machine::keyPress(SDL_Keysym key, bool key_pressed){
         case SDLK_d: // Player 2 Right
             bit_port2 = 0x40; // bit 6
             break;
+        // emulator controls
+        case SDLK_TAB: // fast-forward while held
+            this->fast_forward_key = key_pressed;
+            if(!key_pressed){
+                this->options.fast_forward = false; // releasing TAB also ends --fast-forward
+            }
+            break;
+#ifdef ENABLE_DEBUGGER
+        case SDLK_F12: // break into the debugger on the console
+            if(key_pressed) this->debugger.request_break();
+            break;
+#endif
     }
 
     if(key_pressed){
@@ -102,30 +247,23 @@ void Machine::keyPress(SDL_Keysym key, bool key_pressed){
 
 void Machine::updateScreen(){
     uint16_t framebuffer_loc = 0x2400;
-    uint16_t byte_width = 32;//WIDTH/8;
-    uint16_t current_loc;
-
-    int n = this->screen_width * this->screen_height;
-
+    auto start = std::chrono::steady_clock::now();
 
     uint8_t* emumem = this->emu.memory.get();
-    for(int y=0; y < this->screen_height; y++){
-        for(int x = 0; x < byte_width; x++){
-            current_loc = framebuffer_loc + byte_width*y + x;
-            for(int b=0; b<8;b++){
-                // the screen is the VRAM rotated 90 degrees counterclockwise
-                int screen_location = n-(this->screen_height-y)-this->screen_height*(8*x+b);
-                uint32_t color = ((emumem[current_loc]>>b) & 1)? 0xFFFFFF : 0x000000;
-                this->textureBuffer[screen_location] = color;
-            }
+    {
+        TraceSpan span(this->trace.get(), "convert", "present", this->frame_count);
+        if(this->ahead_vram){
+            this->scaler.render(this->ahead_vram.get(), this->textureBuffer.get(), this->scaler.width());
+        } else {
+            this->scaler.render(emumem + framebuffer_loc, this->textureBuffer.get(), this->scaler.width());
         }
     }
 
     SDL_Rect texture_rect;
     texture_rect.x = 0;
     texture_rect.y = 0;
-    texture_rect.w = this->screen_height;
-    texture_rect.h = this->screen_width;
+    texture_rect.w = this->scaler.width();
+    texture_rect.h = this->scaler.height();
 
     SDL_Rect window_rect;
     window_rect.x = 0;
@@ -133,53 +271,482 @@ void Machine::updateScreen(){
     window_rect.w = this->window_width;
     window_rect.h = this->window_height;
 
-    SDL_UpdateTexture(this->texture, NULL, textureBuffer.get(), this->screen_height*sizeof(uint32_t));
-    SDL_RenderClear(this->renderer);
-    SDL_RenderCopy(this->renderer, this->texture, &texture_rect, &window_rect);
-    SDL_RenderPresent(this->renderer);
+    {
+        TraceSpan span(this->trace.get(), "upload", "present", this->frame_count);
+        SDL_UpdateTexture(this->texture, NULL, textureBuffer.get(), this->scaler.width()*sizeof(uint32_t));
+        SDL_RenderClear(this->renderer);
+        SDL_RenderCopy(this->renderer, this->texture, &texture_rect, &window_rect);
+    }
+    auto present_start = std::chrono::steady_clock::now();
+    {
+        TraceSpan span(this->trace.get(), "present", "present", this->frame_count);
+        SDL_RenderPresent(this->renderer);
+    }
+    if(this->metrics){
+        auto end = std::chrono::steady_clock::now();
+        this->metrics->update_screen_ns.add(std::chrono::duration_cast<std::chrono::nanoseconds>(present_start - start).count());
+        this->metrics->update_screen_calls.add(1);
+        this->metrics->present_ns.add(std::chrono::duration_cast<std::chrono::nanoseconds>(end - present_start).count());
+        this->metrics->presents.add(1);
+    }
+    if(this->latency){
+        this->latency->presented();
+    }
+}
+
+void Machine::updateTitle(double speed){
+    char title[64];
+    if(speed > 0){
+        snprintf(title, sizeof(title), "Space Invaders - fast-forward %.1fx", speed);
+    } else {
+        snprintf(title, sizeof(title), "Space Invaders");
+    }
+    SDL_SetWindowTitle(this->win, title);
 }
 
 void Machine::interrupt(int num){
     if(!this->emu.interrupt_enabled) return;
+    if(this->emu.halted){
+        // continue after the HLT instruction once the interrupt returns
+        this->emu.halted = false;
+        this->emu.pc++;
+    }
     emu.call(0x08*num, 0); // Instruction: RST 1 -> Call 0x08
     emu.interrupt_enabled = false;
+    emu.cycles += 11;      // an RST takes as long as the instruction
+}
+
+void Machine::count_interrupt(uint64_t due){
+    if(!this->emu.interrupt_enabled){
+        this->metrics->interrupts_dropped.add(1);
+        return;
+    }
+    this->metrics->interrupts.add(1);
+    // an instruction that started before the interrupt was due always finishes first,
+    // anything later comes from native ROM routines (--hle) or a stop in the debugger
+    const uint64_t LONGEST_INSTRUCTION = 18; // XTHL
+    if(this->emu.cycles - due > LONGEST_INSTRUCTION){
+        this->metrics->interrupts_late.add(1);
+    }
+}
+
+void Machine::publish_metrics(uint64_t frame_cycles){
+    // the superinstructions and OUT 4; IN 3 are one step for several instructions
+    uint64_t instructions = this->steps + this->fused_shifts;
+    for(int kind=SUPER_NONE+1; kind<SUPER_COUNT; kind++){
+        instructions += this->emu.superinstruction_runs[kind] * (Emulator::superinstruction_length(kind) - 1);
+    }
+    this->metrics->instructions.set(instructions);
+    this->metrics->cycles.add(frame_cycles);
+    if(!this->running_ahead){
+        this->metrics->frames.add(1);
+    }
+}
+
+void Machine::run_until(uint64_t cycle){
+    if(this->hash_log && (int64_t) this->frame_count == this->options.hash_frame && !this->running_ahead){
+        run_hashed(cycle);
+        return;
+    }
+    // profiling has its own copy of the loop, so the normal one doesn't test for it
+    if(this->profiler){
+        run_loop<true>(cycle);
+    } else {
+        run_loop<false>(cycle);
+    }
+}
+
+template<bool profile>
+void Machine::run_loop(uint64_t cycle){
+    // the profile and the debugger see every instruction on its own
+    this->emu.fuse_limit = (!profile && this->options.fusion) ? cycle : 0;
+    this->idle_skip = !profile && this->options.idle_skip;
+    this->idle_loop.valid = false; // the interrupt before may have changed anything
+    uint64_t steps = 0; // counted in a register, the member is updated once
+    while(this->emu.cycles < cycle){
+#ifdef ENABLE_DEBUGGER
+        // without breakpoints this is the only test per instruction
+        if(this->debugger.armed){
+            this->emu.fuse_limit = 0;
+            this->idle_skip = false;
+            if(this->debugger.check() && !debug_stop()){
+                this->quit = true;
+                break;
+            }
+        }
+#endif
+        steps++;
+        if(profile){
+            uint16_t pc = this->emu.pc;
+            uint64_t start = this->emu.cycles;
+            execute_next_instruction();
+            this->profiler->sample(pc, this->emu.cycles - start);
+        } else {
+            uint16_t pc = this->emu.pc;
+            execute_next_instruction();
+            if((uint16_t) (pc - this->emu.pc - 1) < IDLE_LOOP_BYTES && this->idle_skip){
+                skip_idle_loop(cycle);
+            }
+        }
+    }
+    this->steps += steps;
+}
+
+// called after a short jump back, skips the rounds of the loop that fit before the next interrupt
+void Machine::skip_idle_loop(uint64_t cycle){
+    const Emulator& emu = this->emu;
+    IdleLoop& loop = this->idle_loop;
+    if(!loop.valid || loop.writes != emu.writes || loop.pc != emu.pc){
+        // a loop that writes memory (copy, clear) or another loop, the cheap case
+        loop.valid = true;
+        loop.packed = false;
+        loop.pc = emu.pc;
+        loop.writes = emu.writes;
+        return;
+    }
+    uint64_t registers = (uint64_t) emu.a | (uint64_t) emu.b << 8 | (uint64_t) emu.c << 16 | (uint64_t) emu.d << 24 |
+                         (uint64_t) emu.e << 32 | (uint64_t) emu.h << 40 | (uint64_t) emu.l << 48 | (uint64_t) emu.flags << 56;
+    uint64_t pointers = (uint64_t) emu.sp | (uint64_t) emu.pc << 16 | (uint64_t) emu.interrupt_enabled << 32 |
+                        (uint64_t) this->shifter.value << 40 | (uint64_t) this->shifter.amount << 56;
+    if(loop.packed && loop.registers == registers && loop.pointers == pointers && emu.cycles < cycle){
+        // the same state, only the interrupt can change what happens next
+        uint64_t round = emu.cycles - loop.cycles;
+        uint64_t rounds = (cycle - 1 - emu.cycles) / round; // the last round is run, it ends after cycle
+        this->emu.cycles += rounds * round;
+        this->idle_cycles += rounds * round;
+    }
+    loop.packed = true;
+    loop.registers = registers;
+    loop.pointers = pointers;
+    loop.cycles = emu.cycles;
+}
+
+// logs the hash after every instruction, to find the first one that differs from another run
+void Machine::run_hashed(uint64_t cycle){
+    this->emu.fuse_limit = 0;
+    while(this->emu.cycles < cycle){
+        uint16_t pc = this->emu.pc;
+        execute_next_instruction();
+        this->steps++;
+        this->hash_log->instruction(this->hashed_instructions++, pc, state_hash());
+    }
+}
+
+#ifdef ENABLE_DEBUGGER
+// the emulation stopped in the debugger, gdb gets control if it is connected.
+// Returns false if the user quit.
+bool Machine::debug_stop(){
+    if(this->gdb && this->gdb->connected()){
+        return this->gdb->wait();
+    }
+    return this->debugger.prompt();
+}
+#endif
+
+uint64_t Machine::state_hash() const{
+    uint64_t devices = (uint64_t) this->shifter.value | (uint64_t) this->shifter.amount << 16 |
+                       (uint64_t) this->out_port0 << 24 | (uint64_t) this->out_port1 << 32 | (uint64_t) this->out_port2 << 40;
+    return Emulator::mix(this->emu.state_hash() ^ devices);
+}
+
+// how many of the instructions ran fused, by sequence, and how many cycles idle loops skipped
+void Machine::print_statistics() const{
+    if(this->emu.cycles > 0){
+        printf("%.1f%% of %llu cycles skipped in idle loops\n", 100.0 * this->idle_cycles / this->emu.cycles,
+            (unsigned long long) this->emu.cycles);
+    }
+    uint64_t runs[SUPER_COUNT];
+    uint64_t total = 2 * this->fused_shifts;
+    for(int kind=SUPER_NONE; kind<SUPER_COUNT; kind++){
+        runs[kind] = this->emu.superinstruction_runs[kind];
+        total += runs[kind] * Emulator::superinstruction_length(kind);
+    }
+    if(total == 0) return;
+    uint64_t fused = total - runs[SUPER_NONE];
+    printf("%.1f%% of %llu instructions ran fused\n", 100.0 * fused / total, (unsigned long long) total);
+    for(int kind=SUPER_NONE+1; kind<SUPER_COUNT; kind++){
+        uint64_t covered = runs[kind] * Emulator::superinstruction_length(kind);
+        printf("  %-32s %5.1f%%\n", Emulator::superinstruction_name(kind), 100.0 * covered / total);
+    }
+    printf("  %-32s %5.1f%%\n", "OUT 4; IN 3", 100.0 * 2 * this->fused_shifts / total);
+}
+
+void Machine::save_state(MachineState& state) const{
+    state.emu.copy_state_from(this->emu);
+    state.shifter = this->shifter;
+    state.out_port0 = this->out_port0;
+    state.out_port1 = this->out_port1;
+    state.out_port2 = this->out_port2;
+    state.frame_count = this->frame_count;
+}
+
+void Machine::load_state(const MachineState& state){
+    this->emu.copy_state_from(state.emu);
+    this->shifter = state.shifter;
+    this->out_port0 = state.out_port0;
+    this->out_port1 = state.out_port1;
+    this->out_port2 = state.out_port2;
+    this->frame_count = state.frame_count;
+    this->recording_log.truncate(this->frame_count); // the following frames are recorded again
+}
+
+void Machine::set_input(const FrameInput& input){
+    this->out_port0 = input.port0;
+    this->out_port1 = input.port1;
+    this->out_port2 = input.port2;
+}
+
+void Machine::run_frame(){
+#ifdef ENABLE_DEBUGGER
+    if(this->gdb){
+        this->gdb->poll(); // never blocks
+    }
+#endif
+    // inputs only change between frames, so a recording reproduces the session exactly.
+    // With netplay the replay is only the local player's keys
+    if(!this->netplay && this->frame_count < this->replay_log.size()){
+        set_input(this->replay_log[this->frame_count]);
+    }
+    if(!this->options.record_file.empty() && !this->running_ahead){
+        this->recording_log.append(current_input());
+    }
+
+    // the interrupts are scheduled by emulated cycles, not by wall clock time,
+    // so a frame behaves the same no matter how fast it is run
+    uint64_t frame_start = this->frame_count * this->cycles_per_frame;
+    uint64_t cycles_before = this->emu.cycles;
+    Trace* trace = this->trace.get();
+    const char* category = this->running_ahead ? "run ahead" : "emulation";
+    {
+        TraceSpan span(trace, "emulate", category, this->frame_count);
+        run_until(frame_start + this->cycles_per_frame/2);
+    }
+    if(this->metrics) count_interrupt(frame_start + this->cycles_per_frame/2);
+    {
+        TraceSpan span(trace, "RST 1", category, this->frame_count);
+        interrupt(1); // RST 1 interrupt at half drawn screen
+    }
+    {
+        TraceSpan span(trace, "emulate", category, this->frame_count);
+        run_until(frame_start + this->cycles_per_frame);
+    }
+    if(this->metrics) count_interrupt(frame_start + this->cycles_per_frame);
+    {
+        TraceSpan span(trace, "RST 2", category, this->frame_count);
+        interrupt(2); // RST 2 interrupt at end of screen
+    }
+    if(this->metrics) publish_metrics(this->emu.cycles - cycles_before);
+    if(this->hash_log && !this->running_ahead){
+        this->hash_log->frame(this->frame_count, state_hash());
+        this->hashed_instructions = 0;
+    }
+    this->frame_count++;
+    if(this->running_ahead){
+        return; // the frame is taken back, only the picture is used
+    }
+
+    if(this->nvram){
+        // the boot code initialises the RAM, so the saved values are written back after it
+        if(this->frame_count == this->board.nvram_restore_frame){
+            this->nvram->restore(this->emu);
+        } else {
+            this->nvram->update(this->emu);
+        }
+    }
+    if(this->capture){
+        this->capture->add(this->emu.memory.get() + 0x2400);
+    }
+    if(this->latency && !this->hidden_frame){
+        this->latency->frame_done(this->emu.memory.get() + 0x2400);
+    }
+}
+
+// runs a frame with other inputs, the keys pressed until now stay pressed for the next one
+void Machine::run_frame_with(const FrameInput& input){
+    FrameInput keyboard = current_input();
+    set_input(input);
+    run_frame();
+    set_input(keyboard);
+}
+
+void Machine::netplay_frame(){
+    this->netplay->receive();
+    netplay_rollback();
+    if(!this->netplay->can_advance(this->frame_count)){
+        this->netplay->send(); // in case our last inputs were lost
+        return;
+    }
+    FrameInput keyboard = current_input();
+    if(this->frame_count < this->replay_log.size()){
+        keyboard = this->replay_log[this->frame_count];
+    }
+    this->netplay->set_local(this->frame_count, keyboard);
+    this->netplay->send();
+    save_state(this->snapshots[this->frame_count % (Netplay::MAX_ROLLBACK + 1)]);
+    run_frame_with(this->netplay->inputs(this->frame_count));
+    this->netplay->set_hash(this->frame_count - 1, state_hash());
+}
+
+// an input of the other player differs from the prediction: go back to that frame and
+// run the frames up to now again with the real inputs
+void Machine::netplay_rollback(){
+    uint64_t frame;
+    if(!this->netplay->rollback(frame)) return;
+    uint64_t end = this->frame_count;
+    FrameInput keyboard = current_input();
+    load_state(this->snapshots[frame % (Netplay::MAX_ROLLBACK + 1)]);
+    set_input(keyboard);
+    while(this->frame_count < end){
+        save_state(this->snapshots[this->frame_count % (Netplay::MAX_ROLLBACK + 1)]);
+        run_frame_with(this->netplay->inputs(this->frame_count));
+        this->netplay->set_hash(this->frame_count - 1, state_hash());
+    }
+}
+
+// the last frames may have run with predicted inputs: wait for the real ones, so both sides
+// end in the same state. Gives up after two seconds if the other side is gone
+void Machine::netplay_finish(){
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while(!this->netplay->synced(this->frame_count) && std::chrono::steady_clock::now() < deadline){
+        this->netplay->send();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        this->netplay->receive();
+        netplay_rollback();
+    }
+}
+
+void Machine::step(){
+    if(this->netplay){
+        netplay_frame(); // doesn't always advance a frame
+    } else {
+        run_frame();
+    }
+}
+
+// Run-ahead: the real frame runs, then the next frames with the same keys, and the last of
+// those is shown. The game reacts to a key as many frames earlier as it has frames of input
+// lag itself, up to run_ahead. Then the state goes back to the real frame.
+void Machine::run_ahead_frame(){
+    // --latency-stats follows the frames that are shown, the last one ahead
+    this->hidden_frame = true;
+    step();
+    this->hidden_frame = false;
+    TraceSpan span(this->trace.get(), "run ahead", "run ahead", this->frame_count);
+    save_state(*this->ahead_state);
+    this->running_ahead = true;
+    for(int i=0; i<this->options.run_ahead; i++){
+        run_frame();
+    }
+    this->running_ahead = false;
+    memcpy(this->ahead_vram.get(), this->emu.memory.get() + 0x2400, VramView::size);
+    load_state(*this->ahead_state);
+    if(this->latency){
+        this->latency->frame_done(this->ahead_vram.get());
+    }
+}
+
+void Machine::run_frames(uint64_t frames){
+    uint64_t end = this->frame_count + frames;
+    while(this->frame_count < end && !this->quit){
+        step();
+    }
 }
 
 void Machine::run(){
+    using clock = std::chrono::steady_clock;
 
-    uint32_t t_lastInterrupt = SDL_GetTicks();
-    bool first_half = true;
+    FramePacer pacer(1000000000/60);
+    auto speed_start = clock::now(); // start of the current speed measurement
+    uint64_t speed_frames = 0;       // frames emulated since speed_start
+    bool was_fast_forward = false;
     bool exit_clicked = false;
-    while(!exit_clicked){
-        execute_next_instruction();
-        SDL_PollEvent(&this->event);
-        switch(this->event.type){
-            case SDL_QUIT:
-                exit_clicked = true;
-                exit(0);
-                break;
-            case SDL_KEYDOWN:
-                keyPress(this->event.key.keysym, true);  // true = key pressed
-                break;
-            case SDL_KEYUP:
-                keyPress(this->event.key.keysym, false); // false = key depressed
-                break;
+    while(!exit_clicked && !this->quit){
+        if(this->metrics){
+            SDL_PumpEvents();
+            int depth = SDL_PeepEvents(NULL, 0, SDL_PEEKEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT);
+            if(depth >= 0){
+                this->metrics->input_queue_depth.set(depth);
+                if((uint64_t) depth > this->metrics->input_queue_max.get()) this->metrics->input_queue_max.set(depth);
+            }
         }
-        uint32_t t_current = SDL_GetTicks();
-        if(this->emu.interrupt_enabled && (first_half && t_current-t_lastInterrupt > 8)){
-            this->emu.call(0x08, 0);// RST 1 interrupt at half drawn screen
-            this->emu.interrupt_enabled = false;
-            first_half = false;
+        uint64_t poll_start = this->trace ? this->trace->now() : 0;
+        while(SDL_PollEvent(&this->event)){
+            switch(this->event.type){
+                case SDL_QUIT:
+                    exit_clicked = true;
+                    break;
+                case SDL_KEYDOWN:{
+                    FrameInput before = current_input();
+                    keyPress(this->event.key.keysym, true);  // true = key pressed
+                    if(this->latency && !this->event.key.repeat){
+                        // follow the first bit the key set
+                        uint8_t before_ports[3] = {before.port0, before.port1, before.port2};
+                        uint8_t ports[3] = {this->out_port0, this->out_port1, this->out_port2};
+                        for(int port=0; port<3; port++){
+                            uint8_t set = ports[port] & ~before_ports[port];
+                            if(set){
+                                this->latency->key_down(port, set & -set, SDL_GetTicks() - this->event.key.timestamp);
+                                break;
+                            }
+                        }
+                    }
+                    break;
+                }
+                case SDL_KEYUP:
+                    keyPress(this->event.key.keysym, false); // false = key depressed
+                    break;
+            }
+        }
+        if(this->trace){
+            this->trace->add("poll events", "input", poll_start, this->trace->now(), this->frame_count);
+        }
+        if(this->options.fast_forward_frames && this->frame_count >= this->options.fast_forward_frames){
+            this->options.fast_forward = false;
+        }
+        bool fast_forward = this->fast_forward_key || this->options.fast_forward;
+
+        if(this->options.run_ahead > 0 && !fast_forward){
+            run_ahead_frame();
+        } else {
+            step();
+            if(this->ahead_vram) memcpy(this->ahead_vram.get(), this->emu.memory.get() + 0x2400, VramView::size);
+        }
+        speed_frames++;
+
+        if(!fast_forward){
+            updateScreen();
+        } else if(this->options.frameskip > 0 && this->frame_count % this->options.frameskip == 0){
+            updateScreen();
+        }
+
+        auto now = clock::now();
+        if(fast_forward != was_fast_forward){
+            // restart the speed measurement when switching modes
+            speed_start = now;
+            speed_frames = 0;
+            if(fast_forward){
+                pacer.pause();
+            } else {
+                updateTitle(0);
+                pacer.restart(); // pacing starts again from the moment fast-forward is released
+            }
+            was_fast_forward = fast_forward;
+        } else if(fast_forward && now - speed_start >= std::chrono::seconds(1)){
+            double seconds = std::chrono::duration<double>(now - speed_start).count();
+            updateTitle(speed_frames / (seconds * 60));
+            speed_start = now;
+            speed_frames = 0;
         }
 
-        if(this->emu.interrupt_enabled && (t_current-t_lastInterrupt > 17)){
-             t_lastInterrupt = t_current;
-             this->emu.call(0x10, 0);// RST 2 interrupt at end of screen
-             this->emu.interrupt_enabled = false;
-             first_half = true;
-             updateScreen();
+        if(!fast_forward){
+            TraceSpan span(this->trace.get(), "sleep", "pacing", this->frame_count);
+            pacer.wait(); // the keys are read right after it, for the next frame
+            if(this->metrics) this->metrics->frames_late.set(pacer.late_frames());
         }
     }
+    if(this->options.pace_stats){
+        pacer.print_statistics();
+    }
     return;
 }
 
@@ -188,41 +755,53 @@ void Machine::execute_next_instruction(){
     // IN and OUT instructions get intercepted
 
     if(this->emu.memory[this->emu.pc] == 0xd3){ // OUT instruction
-        switch(this->emu.memory[this->emu.pc+1]){ // PORT NUMBER
-            case 2:
-                this->shift_amount = this->emu.a & 0x07;
-                break;
-            case 3:
-                // Sounds (Unimplemented)
+        switch(this->out_ports[this->emu.memory[this->emu.pc+1]]){ // PORT NUMBER
+            case PORT_SHIFT_AMOUNT:
+                this->shifter.set_amount(this->emu.a);
                 break;
-            case 4:
-                this->shift0 = this->shift1;
-                this->shift1 = this->emu.a;
+            case PORT_SHIFT_DATA:
+                this->shifter.push(this->emu.a);
+                // OUT 4; IN 3 is how the ROM shifts every byte of a sprite, both are done in one
+                // step unless an interrupt is due between them
+                if(this->emu.cycles + 10 < this->emu.fuse_limit && this->emu.pc + 3u < this->emu.RAM_size &&
+                   this->emu.memory[this->emu.pc+2] == 0xdb &&
+                   this->in_ports[this->emu.memory[this->emu.pc+3]] == PORT_SHIFT_RESULT){
+                    this->emu.a = this->shifter.result();
+                    this->emu.pc += 4;
+                    this->emu.cycles += 10 + 10;
+                    this->fused_shifts++;
+                    return;
+                }
                 break;
-            case 5:
-                // more sounds (Unimplemented)
+            case PORT_SOUND:
+                // Sounds (Unimplemented)
                 break;
         }
-        return;
     } else if(this->emu.memory[this->emu.pc] == 0xdb){ // IN instruction
-        switch(this->emu.memory[this->emu.pc+1]){ // PORT NUMBER
-            case 0:
+        switch(this->in_ports[this->emu.memory[this->emu.pc+1]]){ // PORT NUMBER
+            case PORT_INPUT0:
                 this->emu.a = this->out_port0;
                 break;
-            case 1: // Button presses here
+            case PORT_INPUT1: // Button presses here
                 this->emu.a = this->out_port1;
                 break;
-            case 2: // settings and player 2 controls (Unimplemented)
+            case PORT_INPUT2: // settings and player 2 controls
                 this->emu.a = this->out_port2;
                 break;
-            case 3:{
-                uint16_t v = (this->shift1<<8) | this->shift0;
-                this->emu.a = ((v >> (8-this->shift_amount))& 0xFF);
-                }
+            case PORT_SHIFT_RESULT:
+                this->emu.a = this->shifter.result();
                 break;
         }
-        return;
+        if(this->latency && this->latency->waiting_for_read() && !this->hidden_frame){
+            uint8_t function = this->in_ports[this->emu.memory[this->emu.pc+1]];
+            if(function >= PORT_INPUT0 && function <= PORT_INPUT2){
+                // frames run ahead are compared with the picture shown last
+                const uint8_t* vram = this->running_ahead ? this->ahead_vram.get() : this->emu.memory.get() + 0x2400;
+                this->latency->port_read(function - PORT_INPUT0, this->emu.a, vram);
+            }
+        }
     }
 
+    // the CPU itself only skips over the port number of IN and OUT
     this->emu.execute_next_instruction();
 }
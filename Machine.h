@@ -2,6 +2,25 @@
 #define MACHINE_H
 
 #include "Emulator.h"
+#include "Scaler.h"
+#include "BoardProfile.h"
+#include "RomLoader.h"
+#include "InputLog.h"
+#include "Debugger.h"
+#include "GdbStub.h"
+#include "SymbolTable.h"
+#include "Profiler.h"
+#include "Hle.h"
+#include "NvramStore.h"
+#include "VideoCapture.h"
+#include "Observation.h"
+#include "Netplay.h"
+#include "HashLog.h"
+#include "ShiftRegister.h"
+#include "FramePacer.h"
+#include "InputLatency.h"
+#include "Metrics.h"
+#include "Trace.h"
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
 #include <SDL2/SDL_timer.h>
@@ -9,14 +28,68 @@
 #include <thread>
 #include <string>
 
+// settings given on the command line
+
+struct MachineOptions {
+    std::string board = "invaders"; // name of the board profile
+    bool ignore_crc = false;     // load ROM files even if their checksum is wrong
+    int dip_switches = -1;       // DIP switch bits of port 2 (-1 = profile default)
+    bool fast_forward = false;   // start in fast-forward mode (until TAB is pressed)
+    uint64_t fast_forward_frames = 0; // fast-forward only the first n frames (0 = no limit)
+    int frameskip = 10;          // while fast-forwarding draw every nth frame (0 = never)
+    int scale = 1;               // scale the picture on the CPU (1 = let the renderer stretch it)
+    bool scanlines = false;
+    bool overlay = false;        // coloured strips like on the cabinet
+    bool software_renderer = false; // don't use the GPU at all
+    bool headless = false;       // no window, the machine is driven by run_frames
+    std::string record_file;     // save the inputs of every frame to this file at exit
+    std::string replay_file;     // play back inputs recorded with record_file
+    bool debug = false;          // stop in the debugger before the first instruction
+    std::string gdb;             // serve gdb on this TCP port or Unix socket path (empty = off)
+    std::string symbol_file;     // names of the ROM routines for the profiler and the debugger
+    std::string profile_file;    // write the profile here at exit ("-" = stdout, empty = don't profile)
+    bool hle = false;            // run native versions of hot ROM routines
+    bool hle_validate = false;   // ... and compare them to the ROM on every call
+    std::string nvram_file;      // keep the high score and credits of the board in this file
+    std::string capture_file;    // record every frame to this .y4m, .rgb/.raw or .png file
+    int netplay_player = 0;      // 1 or 2 for a two player game with another process, 0 = off
+    int netplay_port = 7480;     // player 1 uses this UDP port, player 2 the next one
+    std::string hash_log;        // write the state hash of every frame to this file
+    int64_t hash_frame = -1;     // ... and of every instruction of this frame
+    bool fusion = true;          // run common instruction sequences in one step
+    bool idle_skip = true;       // skip the cycles of loops that only wait for the next interrupt
+    bool pace_stats = false;     // print the CPU use and wake-up jitter of the pacing at exit
+    bool latency_stats = false;  // measure the time from key presses to the screen, printed at exit
+    int run_ahead = 0;           // frames shown ahead of the emulated one, to hide the game's input lag
+    std::string metrics_file;    // rewrite counters in the Prometheus text format to this file every second
+    std::string trace_file;      // write a timeline of the frame phases in the Chrome trace event format
+};
+
+// everything that changes while the machine runs, for rollback
+struct MachineState {
+    Emulator emu;
+    ShiftRegister shifter;
+    uint8_t out_port0, out_port1, out_port2;
+    uint64_t frame_count;
+};
+
 // This class represents the arcade machine and displays video signal with SDL
 
 class Machine
 {
     public:
-        Machine(const std::string& filename="invaders.bin");
+        Machine(const MachineOptions& options = MachineOptions());
         virtual ~Machine();
         void run();
+        void run_frames(uint64_t frames); // emulate uncapped without displaying anything
+        void replay(const InputLog& log) { this->replay_log = log; }
+        FrameInput current_input() const { return {this->out_port0, this->out_port1, this->out_port2}; }
+        VramView vram() const { return {this->emu.memory.get() + 0x2400}; } // for Observation, no copy
+        uint64_t state_hash() const; // CPU, memory, shift register and ports
+        void save_state(MachineState& state) const;
+        void load_state(const MachineState& state);
+        void print_statistics() const; // share of the fused instructions and the skipped cycles
+        void run_ahead_frame();        // one frame with --run-ahead, run() uses it instead of run_frames(1)
 
     private:
 
@@ -24,7 +97,12 @@ class Machine
         SDL_Renderer* renderer;
         SDL_Texture* texture;
         unique_ptr<uint32_t[]> textureBuffer;
+        Scaler scaler;
         Emulator emu;
+#ifdef ENABLE_DEBUGGER
+        Debugger debugger;
+        unique_ptr<GdbStub> gdb;
+#endif
         SDL_Event event;
 
         int screen_width  = 256;
@@ -32,18 +110,90 @@ class Machine
         int window_width  = 224*3;
         int window_height = 256*3;
 
-        uint8_t shift0; // lower byte of shift register
-        uint8_t shift1; // higher byte of shift register
-        uint8_t shift_amount; // how much to shift the shift register
+        // the 8080 runs at 2 MHz and the screen is refreshed 60 times a second
+        const uint64_t cycles_per_frame = 2000000/60;
+        uint64_t frame_count = 0;
+
+        MachineOptions options;
+        bool fast_forward_key = false; // TAB held down
+        bool quit = false;             // the user quit in the debugger
+
+        unique_ptr<InputLatency> latency;
+        unique_ptr<Metrics> metrics;
+        unique_ptr<Trace> trace;
+        uint64_t steps = 0; // of the CPU, a fused sequence is one
+
+        ShiftRegister shifter;
+        uint64_t fused_shifts = 0; // OUT 4; IN 3 run in one step
+
+        // A loop that waits for an interrupt reads a flag in RAM until the interrupt routine
+        // changes it. If the registers are the same as when the loop last jumped back and
+        // nothing was written, every further round is the same, so the rounds up to the next
+        // interrupt are skipped by only adding their cycles.
+        static const uint16_t IDLE_LOOP_BYTES = 16; // the longest jump back that is checked
+        struct IdleLoop {
+            bool valid = false;           // pc and writes are from the last jump back
+            bool packed = false;          // registers, pointers and cycles too
+            uint16_t pc;
+            uint64_t writes;
+            uint64_t registers, pointers; // packed CPU and shift register state at the jump back
+            uint64_t cycles;
+        };
+        IdleLoop idle_loop;
+        bool idle_skip = false;       // in the current run_loop
+        uint64_t idle_cycles = 0;     // skipped
 
         uint8_t out_port0 = 0x0F; // first four bits always 1, then fire, left, right
         uint8_t out_port1 = 0x09; // player 1 controls, 1P/2P START, CREDIT, bit 3 is always 1
         uint8_t out_port2 = 0x03; // player 2 controls, difficulty dip switches, lives: 3+2*(bit1)+(bit0)
 
+        // what is connected to each port number, filled from the board profile
+        enum PortFunction : uint8_t {
+            PORT_NONE, PORT_INPUT0, PORT_INPUT1, PORT_INPUT2, PORT_SHIFT_RESULT,
+            PORT_SHIFT_AMOUNT, PORT_SHIFT_DATA, PORT_SOUND, PORT_WATCHDOG
+        };
+        uint8_t in_ports[256];
+        uint8_t out_ports[256];
+        BoardProfile board;
+        shared_ptr<const RomImage> rom;
+
+        InputLog recording_log;
+        InputLog replay_log;
+
+        SymbolTable symbols;
+        unique_ptr<Profiler> profiler;
+        unique_ptr<Hle> hle;
+        unique_ptr<NvramStore> nvram;
+        unique_ptr<VideoCapture> capture;
+        unique_ptr<Netplay> netplay;
+        unique_ptr<MachineState[]> snapshots; // of the last Netplay::MAX_ROLLBACK+1 frames, by frame
+        unique_ptr<MachineState> ahead_state; // the real state while the frames ahead run
+        unique_ptr<uint8_t[]> ahead_vram;     // the picture of the last frame ahead, shown instead
+        bool running_ahead = false;           // the frame will be taken back, it has no side effects
+        bool hidden_frame = false;            // a real frame whose picture the frames run ahead replace
+        unique_ptr<HashLog> hash_log;
+        uint64_t hashed_instructions = 0;     // of the frame that is logged per instruction
+
+        void load_roms();
         void keyPress(SDL_Keysym key, bool key_pressed);
         void updateScreen();
+        void updateTitle(double speed);
         void execute_next_instruction();
+        void skip_idle_loop(uint64_t cycle);
+        void run_until(uint64_t cycle);
+        template<bool profile> void run_loop(uint64_t cycle);
+        void run_hashed(uint64_t cycle);
+        bool debug_stop();
+        void run_frame();
+        void set_input(const FrameInput& input);
+        void run_frame_with(const FrameInput& input);
+        void netplay_frame();
+        void netplay_rollback();
+        void netplay_finish();
+        void step();
         void interrupt(int num);
+        void count_interrupt(uint64_t due);
+        void publish_metrics(uint64_t frame_cycles);
 };
 
 #endif // MACHINE_H
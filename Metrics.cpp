@@ -0,0 +1,75 @@
+#include "Metrics.h"
+#include <stdio.h>
+#include <chrono>
+
+static const auto WRITE_INTERVAL = std::chrono::seconds(1);
+
+Metrics::Metrics(const string& filename)
+    : filename(filename)
+{
+    this->writer = thread(&Metrics::write_loop, this);
+}
+
+Metrics::~Metrics()
+{
+    {
+        lock_guard<mutex> lock(this->stop_mutex);
+        this->stop = true;
+    }
+    this->stop_signal.notify_one();
+    this->writer.join();
+}
+
+void Metrics::write_loop(){
+    using clock = std::chrono::steady_clock;
+    auto last = clock::now();
+    uint64_t instructions = 0, frames = 0;
+    bool stopping = false;
+    while(!stopping){
+        {
+            unique_lock<mutex> lock(this->stop_mutex);
+            stopping = this->stop_signal.wait_for(lock, WRITE_INTERVAL, [this](){ return this->stop.load(); });
+        }
+        auto now = clock::now();
+        write_file(std::chrono::duration<double>(now - last).count(), instructions, frames);
+        last = now;
+        instructions = this->instructions.get();
+        frames = this->frames.get();
+    }
+}
+
+void Metrics::write_file(double seconds, uint64_t instructions_before, uint64_t frames_before){
+    string temporary = this->filename + ".tmp";
+    FILE* fp = fopen(temporary.c_str(), "w");
+    if(fp == NULL){
+        fprintf(stderr, "Can not write metrics file: %s\n", temporary.c_str());
+        return;
+    }
+    auto metric = [fp](const char* name, const char* type, const char* help, double value){
+        fprintf(fp, "# HELP emulator_%s %s\n# TYPE emulator_%s %s\nemulator_%s %.17g\n", name, help, name, type, name, value);
+    };
+    uint64_t instructions = this->instructions.get();
+    uint64_t frames = this->frames.get();
+    metric("instructions_total", "counter", "8080 instructions emulated", instructions);
+    metric("instructions_per_second", "gauge", "8080 instructions emulated per second in the last interval",
+        seconds > 0 ? (instructions - instructions_before) / seconds : 0);
+    metric("cycles_total", "counter", "8080 clock cycles emulated", this->cycles.get());
+    metric("frames_total", "counter", "frames emulated", frames);
+    metric("frames_per_second", "gauge", "frames emulated per second in the last interval",
+        seconds > 0 ? (frames - frames_before) / seconds : 0);
+    metric("frames_late_total", "counter", "frames that started late because the host was too slow", this->frames_late.get());
+    metric("interrupts_total", "counter", "RST 1 and RST 2 interrupts taken", this->interrupts.get());
+    metric("interrupts_dropped_total", "counter", "interrupts not taken because the CPU had them disabled", this->interrupts_dropped.get());
+    metric("interrupts_late_total", "counter", "interrupts taken more than the longest instruction after they were due", this->interrupts_late.get());
+    metric("update_screen_seconds_total", "counter", "time spent converting and uploading the picture", this->update_screen_ns.get() / 1e9);
+    metric("update_screen_calls_total", "counter", "pictures converted and uploaded", this->update_screen_calls.get());
+    metric("present_seconds_total", "counter", "time spent in SDL_RenderPresent", this->present_ns.get() / 1e9);
+    metric("presents_total", "counter", "calls of SDL_RenderPresent", this->presents.get());
+    metric("input_queue_depth", "gauge", "SDL events waiting when the last frame started", this->input_queue_depth.get());
+    metric("input_queue_depth_max", "gauge", "most SDL events waiting when a frame started", this->input_queue_max.get());
+    bool ok = fclose(fp) == 0;
+    if(!ok || rename(temporary.c_str(), this->filename.c_str()) != 0){
+        fprintf(stderr, "Can not write metrics file: %s\n", this->filename.c_str());
+        remove(temporary.c_str());
+    }
+}
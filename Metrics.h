@@ -0,0 +1,58 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <string>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+// This class publishes counters of the running machine for monitoring (--metrics FILE).
+// The emulation thread adds to them once per frame or per run of the CPU, never per
+// instruction. Every counter has this one writer, so a relaxed load and store is enough
+// and no locked instruction slows it down. A thread rewrites FILE every second in the
+// Prometheus text format, through a temporary file that is renamed over the old one, e.g.
+// for the textfile collector of node_exporter. Rates are computed over the last second.
+
+class Metrics
+{
+    public:
+        Metrics(const string& filename);
+        virtual ~Metrics(); // writes the file a last time
+
+        struct Counter {
+            atomic<uint64_t> value{0};
+            void add(uint64_t n) { this->value.store(this->value.load(memory_order_relaxed) + n, memory_order_relaxed); }
+            void set(uint64_t n) { this->value.store(n, memory_order_relaxed); }
+            uint64_t get() const { return this->value.load(memory_order_relaxed); }
+        };
+
+        Counter instructions;         // emulated, a fused sequence counts all of its instructions
+        Counter cycles;
+        Counter frames;
+        Counter interrupts;
+        Counter interrupts_dropped;   // the CPU had interrupts disabled
+        Counter interrupts_late;      // taken more than the longest instruction after they were due
+        Counter frames_late;          // the host was too slow to start them on time
+        Counter update_screen_ns;     // converting the picture and uploading the texture
+        Counter update_screen_calls;
+        Counter present_ns;           // SDL_RenderPresent
+        Counter presents;
+        Counter input_queue_depth;    // SDL events waiting when the frame started
+        Counter input_queue_max;
+
+    private:
+        string filename;
+        atomic<bool> stop{false};
+        mutex stop_mutex;
+        condition_variable stop_signal;
+        thread writer;
+
+        void write_loop();
+        void write_file(double seconds, uint64_t instructions_before, uint64_t frames_before);
+};
+
+#endif // METRICS_H
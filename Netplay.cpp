@@ -0,0 +1,235 @@
+#include "Netplay.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+// the bits of port 1 a player sends: coin, 2P start, 1P start, fire, left, right
+static const uint8_t CONTROLS = 0x77;
+static const uint8_t BUTTONS  = 0x07; // coin and start, shared by both players
+static const int HEADER_SIZE = 23;
+static const uint32_t NO_FRAME = 0xFFFFFFFF;
+
+static void put32(uint8_t* p, uint32_t value){
+    p[0] = value; p[1] = value >> 8; p[2] = value >> 16; p[3] = value >> 24;
+}
+
+static uint32_t get32(const uint8_t* p){
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static void put64(uint8_t* p, uint64_t value){
+    put32(p, value);
+    put32(p + 4, value >> 32);
+}
+
+static uint64_t get64(const uint8_t* p){
+    return get32(p) | ((uint64_t) get32(p + 4) << 32);
+}
+
+Netplay::Netplay(int player, int port, const FrameInput& idle)
+    : player(player), port(port), idle(idle)
+{
+    if(player != 1 && player != 2){
+        throw std::runtime_error("Netplay player has to be 1 or 2");
+    }
+    this->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port + player - 1);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(this->fd < 0 || bind(this->fd, (sockaddr*) &addr, sizeof(addr)) != 0){
+        throw std::runtime_error("Can't open netplay port " + to_string(port + player - 1) + ": " + strerror(errno));
+    }
+    // the other side's port, send() and recv() only talk to it
+    addr.sin_port = htons(port + 2 - player);
+    if(::connect(this->fd, (sockaddr*) &addr, sizeof(addr)) != 0){
+        throw std::runtime_error(string("Can't reach the netplay port: ") + strerror(errno));
+    }
+    fcntl(this->fd, F_SETFL, fcntl(this->fd, F_GETFL, 0) | O_NONBLOCK);
+
+    for(uint64_t i=0; i<HISTORY; i++){
+        this->local[i] = this->remote[i] = this->predicted[i] = idle.port1 & CONTROLS;
+    }
+}
+
+Netplay::~Netplay()
+{
+    close(this->fd);
+}
+
+void Netplay::connect(){
+    printf("Waiting for player %d on port %d\n", 3 - this->player, this->port + 2 - this->player);
+    // both sides send empty packets until they hear from each other
+    while(!this->connected){
+        send();
+        if(wait_packet(100)) receive();
+    }
+    printf("Player %d connected\n", 3 - this->player);
+}
+
+void Netplay::set_local(uint64_t frame, const FrameInput& keyboard){
+    if(frame != this->local_frames) return; // already set before a wait
+    this->local[frame % HISTORY] = keyboard.port1 & CONTROLS;
+    this->local_frames++;
+}
+
+void Netplay::send(){
+    uint8_t packet[HEADER_SIZE + MAX_INPUTS_PER_PACKET];
+    uint64_t first = this->remote_acked;
+    int count = (int) std::min<uint64_t>(this->local_frames - first, MAX_INPUTS_PER_PACKET);
+    packet[0] = 'S';
+    packet[1] = 'I';
+    put32(packet + 2, this->remote_frames);
+    put32(packet + 6, first);
+    packet[10] = count;
+    // the frames before both the received inputs and the frames run are final, after a rollback
+    check_hash();
+    uint64_t settled = std::min(this->remote_frames, this->predicted_until);
+    const FrameHash& last = this->hashes[(settled - 1) % HISTORY];
+    bool has_hash = settled > 0 && last.frame == settled - 1;
+    put32(packet + 11, has_hash ? last.frame : NO_FRAME);
+    put64(packet + 15, has_hash ? last.hash : 0);
+    for(int i=0; i<count; i++){
+        packet[HEADER_SIZE + i] = this->local[(first + i) % HISTORY];
+    }
+    // a full send buffer or a peer that isn't there yet loses the packet, the next one repeats it
+    ::send(this->fd, packet, HEADER_SIZE + count, 0);
+}
+
+bool Netplay::wait_packet(int timeout_ms){
+    // a packet sent while the other side isn't running comes back as an error (ICMP port
+    // unreachable), which wakes poll up without a packet: clear it and wait on
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while(true){
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        pollfd p = {this->fd, POLLIN, 0};
+        int ready = ::poll(&p, 1, std::max<int>(left, 0));
+        if(ready > 0 && (p.revents & POLLIN)) return true;
+        if(ready > 0 && (p.revents & POLLERR)){
+            int error;
+            socklen_t length = sizeof(error);
+            getsockopt(this->fd, SOL_SOCKET, SO_ERROR, &error, &length);
+        }
+        if(ready < 0 && errno != EINTR) return false;
+        if(left <= 0) return false;
+    }
+}
+
+void Netplay::receive(){
+    uint8_t packet[HEADER_SIZE + MAX_INPUTS_PER_PACKET];
+    while(true){
+        ssize_t n = recv(this->fd, packet, sizeof(packet), 0);
+        if(n < 0){
+            if(errno == EINTR || errno == ECONNREFUSED) continue; // the other side isn't listening yet
+            return; // EAGAIN: nothing left
+        }
+        handle_packet(packet, n);
+    }
+}
+
+void Netplay::handle_packet(const uint8_t* data, size_t size){
+    if(size < HEADER_SIZE || data[0] != 'S' || data[1] != 'I' || size != (size_t) HEADER_SIZE + data[10]) return;
+    this->connected = true;
+    uint64_t acked = get32(data + 2);
+    uint64_t first = get32(data + 6);
+    if(acked > this->remote_acked && acked <= this->local_frames){
+        this->remote_acked = acked;
+    }
+    uint32_t hash_frame = get32(data + 11);
+    if(hash_frame != NO_FRAME && (this->remote_hash.frame == NONE || hash_frame > this->remote_hash.frame)){
+        this->remote_hash.frame = hash_frame;
+        this->remote_hash.hash = get64(data + 15);
+    }
+    for(int i=0; i<data[10]; i++){
+        uint64_t frame = first + i;
+        if(frame != this->remote_frames) continue; // already known, or a gap from reordering
+        uint8_t controls = data[HEADER_SIZE + i];
+        this->remote[frame % HISTORY] = controls;
+        this->remote_frames++;
+        if(frame < this->predicted_until && this->predicted[frame % HISTORY] != controls && frame < this->mispredicted){
+            this->mispredicted = frame;
+        }
+    }
+}
+
+FrameInput Netplay::inputs(uint64_t frame){
+    uint8_t other;
+    if(frame < this->remote_frames){
+        other = this->remote[frame % HISTORY];
+    } else {
+        // the other player probably still holds the same keys
+        other = this->remote_frames > 0 ? this->remote[(this->remote_frames - 1) % HISTORY] : this->idle.port1 & CONTROLS;
+        this->predicted[frame % HISTORY] = other;
+    }
+    if(frame >= this->predicted_until){
+        this->predicted_until = frame + 1;
+    }
+    uint8_t mine = this->local[frame % HISTORY];
+    uint8_t p1 = this->player == 1 ? mine : other;
+    uint8_t p2 = this->player == 1 ? other : mine;
+
+    // the bits that differ from idle are pressed, so a key doesn't depend on its polarity
+    uint8_t pressed1 = (p1 ^ this->idle.port1) & CONTROLS;
+    uint8_t pressed2 = (p2 ^ this->idle.port1) & CONTROLS;
+    FrameInput input = this->idle;
+    input.port1 ^= pressed1 | (pressed2 & BUTTONS);
+    input.port2 ^= pressed2 & 0x70; // player 2 fire, left and right have the same bits in port 2
+    return input;
+}
+
+bool Netplay::rollback(uint64_t& frame){
+    if(this->mispredicted == NONE) return false;
+    frame = this->mispredicted;
+    this->mispredicted = NONE;
+    this->rollbacks++;
+    this->resimulated += this->predicted_until - frame;
+    return true;
+}
+
+bool Netplay::can_advance(uint64_t frame){
+    if(frame < this->remote_frames + MAX_ROLLBACK) return true;
+    this->waited++;
+    wait_packet(1);
+    return false;
+}
+
+void Netplay::set_hash(uint64_t frame, uint64_t hash){
+    this->hashes[frame % HISTORY] = {frame, hash};
+}
+
+// compares the other side's hash once our frame is final too
+void Netplay::check_hash(){
+    const FrameHash& remote = this->remote_hash;
+    if(this->desynced || remote.frame == NONE || remote.frame < this->verified) return;
+    if(remote.frame >= std::min(this->remote_frames, this->predicted_until)) return;
+    const FrameHash& local = this->hashes[remote.frame % HISTORY];
+    if(local.frame != remote.frame) return; // too old
+    if(local.hash != remote.hash){
+        printf("Netplay: the games differ after frame %llu (desync), are both using the same ROM and options?\n",
+            (unsigned long long) remote.frame);
+        this->desynced = true;
+        return;
+    }
+    this->verified = remote.frame + 1;
+}
+
+bool Netplay::synced(uint64_t frames) const{
+    return this->remote_frames >= frames && this->remote_acked >= frames;
+}
+
+void Netplay::print_statistics() const{
+    printf("Netplay: %llu rollbacks, %llu frames run again, waited %llu times for player %d, in sync for %llu frames%s\n",
+        (unsigned long long) this->rollbacks, (unsigned long long) this->resimulated,
+        (unsigned long long) this->waited, 3 - this->player, (unsigned long long) this->verified,
+        this->desynced ? ", then desync" : "");
+}
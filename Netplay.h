@@ -0,0 +1,86 @@
+#ifndef NETPLAY_H
+#define NETPLAY_H
+
+#include "InputLog.h"
+#include <stdint.h>
+
+using namespace std;
+
+// This class connects two machines for a two player game over UDP on localhost (--netplay).
+// Every frame each side sends its controls (the player 1 bits of port 1: coin, start,
+// fire, left and right) and runs on without waiting for the other side: missing inputs
+// of the other player are predicted to stay as they were. When the real input arrives
+// and differs, the Machine goes back to the snapshot of that frame and runs the frames
+// again (rollback). A side only waits if it is MAX_ROLLBACK frames ahead of the inputs
+// of the other one.
+// Player 1 plays with the port 1 controls, player 2's fire, left and right go to port 2,
+// coin and start buttons work on both sides. Player 1 binds port, player 2 port+1.
+// Packet: "SI", the number of inputs received from the other side (4 bytes), the frame
+// of the first input (4 bytes), the number of inputs (1 byte), the last frame with the
+// inputs of both sides (4 bytes, 0xFFFFFFFF = none yet) and the state hash after it
+// (8 bytes), then one byte per frame. Inputs are sent again until the other side has
+// received them, so lost packets don't matter. If the state hashes of a frame differ the
+// games have diverged (desync), which is reported once.
+
+class Netplay
+{
+    public:
+        static const int MAX_ROLLBACK = 8;
+
+        // idle: the inputs of the machine without any key pressed, with the DIP switches
+        Netplay(int player, int port, const FrameInput& idle);
+        virtual ~Netplay();
+
+        void connect();                                 // waits until the other side answers
+        void set_local(uint64_t frame, const FrameInput& keyboard); // the next frame's keys
+        void send();
+        void receive();
+
+        // the inputs of both players for a frame, the other player's predicted if still missing
+        FrameInput inputs(uint64_t frame);
+        // returns true and the first frame that was run with a wrong prediction
+        bool rollback(uint64_t& frame);
+        bool can_advance(uint64_t frame);               // counts the frames it had to wait
+        bool synced(uint64_t frames) const;             // both sides have all inputs of the first frames
+        void set_hash(uint64_t frame, uint64_t hash);   // state hash after running the frame
+        void print_statistics() const;
+
+    private:
+        static const uint64_t HISTORY = 256; // inputs kept, far more than a side can run ahead
+        static const uint64_t NONE = ~(uint64_t)0;
+        static const int MAX_INPUTS_PER_PACKET = 64;
+
+        int player;
+        int port;
+        FrameInput idle;
+        int fd = -1;
+        bool connected = false;      // a valid packet came from the other side
+
+        uint8_t local[HISTORY];      // our controls by frame
+        uint8_t remote[HISTORY];     // the other player's controls by frame
+        uint8_t predicted[HISTORY];  // what the frame was run with while remote was missing
+        uint64_t local_frames = 0;   // frames we have controls for
+        uint64_t remote_frames = 0;  // frames we received the other player's controls for
+        uint64_t remote_acked = 0;   // frames of ours that the other side received
+        uint64_t predicted_until = 0; // frames that have been run
+        uint64_t mispredicted = NONE;
+
+        struct FrameHash {
+            uint64_t frame = NONE;
+            uint64_t hash = 0;
+        };
+        FrameHash hashes[HISTORY];   // of the frames run last
+        FrameHash remote_hash;       // the latest final hash from the other side
+        uint64_t verified = 0;       // frames compared with the other side
+        bool desynced = false;
+
+        uint64_t rollbacks = 0;
+        uint64_t resimulated = 0;
+        uint64_t waited = 0;
+
+        bool wait_packet(int timeout_ms);
+        void handle_packet(const uint8_t* data, size_t size);
+        void check_hash();
+};
+
+#endif // NETPLAY_H
@@ -0,0 +1,127 @@
+#include "NvramStore.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <stdexcept>
+
+static const char MAGIC[4] = {'N', 'V', 'R', 'M'};
+static const auto WRITE_INTERVAL = std::chrono::milliseconds(200);
+
+NvramStore::NvramStore(const string& filename, const vector<NvramRange>& ranges)
+    : filename(filename), ranges(ranges)
+{
+    for(const NvramRange& range : ranges){
+        this->size += range.size;
+    }
+    if(this->size == 0 || this->size > MAX_SIZE){
+        throw std::runtime_error("NVRAM ranges of the board are too large or empty");
+    }
+    load();
+    this->writer = thread(&NvramStore::write_loop, this);
+}
+
+NvramStore::~NvramStore()
+{
+    // the writer drains the queue, so this only waits while it is busy
+    while(this->pending && !this->queue.push(this->current)){
+        this_thread::yield();
+    }
+    this->stop = true;
+    this->writer.join();
+}
+
+void NvramStore::load(){
+    FILE* fp = fopen(this->filename.c_str(), "rb");
+    if(fp == NULL) return; // the first run, the file is written when something changes
+    char magic[4];
+    uint8_t size[2];
+    bool ok = fread(magic, 1, 4, fp) == 4 && memcmp(magic, MAGIC, 4) == 0 &&
+              fread(size, 1, 2, fp) == 2 && (size_t) (size[0] | (size[1] << 8)) == this->size &&
+              fread(this->saved.data, 1, this->size, fp) == this->size;
+    fclose(fp);
+    if(!ok){
+        // rather keep the game working than refuse to start, the file is replaced on the next change
+        printf("NVRAM file %s doesn't belong to this board, ignored.\n", this->filename.c_str());
+        return;
+    }
+    this->saved.size = this->size;
+    this->loaded = true;
+}
+
+void NvramStore::gather(const Emulator& emu, Snapshot& snapshot) const{
+    size_t n = 0;
+    for(const NvramRange& range : this->ranges){
+        memcpy(snapshot.data + n, emu.memory.get() + range.adress, range.size);
+        n += range.size;
+    }
+    snapshot.size = n;
+}
+
+void NvramStore::restore(Emulator& emu){
+    if(this->loaded){
+        // the board profile made sure that the ranges are RAM
+        size_t n = 0;
+        for(const NvramRange& range : this->ranges){
+            memcpy(emu.memory.get() + range.adress, this->saved.data + n, range.size);
+            emu.forget_superinstructions(range.adress, range.adress + range.size);
+            n += range.size;
+        }
+        if(emu.hashing) emu.rehash();
+    }
+    // only changes after this point are saved, not the values the boot code left
+    gather(emu, this->current);
+    this->restored = true;
+}
+
+void NvramStore::update(const Emulator& emu){
+    if(!this->restored) return;
+    Snapshot snapshot;
+    gather(emu, snapshot);
+    if(memcmp(snapshot.data, this->current.data, this->size) != 0){
+        this->current = snapshot;
+        this->pending = true;
+    }
+    // a full queue is tried again next frame, newer values replace the pending ones
+    if(this->pending && this->queue.push(this->current)){
+        this->pending = false;
+    }
+}
+
+void NvramStore::write_loop(){
+    Snapshot snapshot;
+    bool stopping = false;
+    while(!stopping){
+        stopping = this->stop; // read before draining, so nothing pushed before stop is missed
+        // everything queued since the last write is saved in one go
+        bool changed = false;
+        while(this->queue.pop(snapshot)){
+            changed = true;
+        }
+        if(changed){
+            write_file(snapshot);
+        }
+        if(!stopping){
+            this_thread::sleep_for(WRITE_INTERVAL);
+        }
+    }
+}
+
+void NvramStore::write_file(const Snapshot& snapshot){
+    // write a new file and rename it over the old one, a crash leaves either of them complete
+    string temporary = this->filename + ".tmp";
+    FILE* fp = fopen(temporary.c_str(), "wb");
+    if(fp == NULL){
+        fprintf(stderr, "Can not write NVRAM file: %s\n", temporary.c_str());
+        return;
+    }
+    uint8_t size[2] = {(uint8_t) (snapshot.size & 0xFF), (uint8_t) (snapshot.size >> 8)};
+    bool ok = fwrite(MAGIC, 1, 4, fp) == 4 && fwrite(size, 1, 2, fp) == 2 &&
+              fwrite(snapshot.data, 1, snapshot.size, fp) == snapshot.size &&
+              fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    ok = fclose(fp) == 0 && ok;
+    if(!ok || rename(temporary.c_str(), this->filename.c_str()) != 0){
+        fprintf(stderr, "Can not write NVRAM file: %s\n", this->filename.c_str());
+        remove(temporary.c_str());
+    }
+}
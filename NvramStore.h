@@ -0,0 +1,61 @@
+#ifndef NVRAMSTORE_H
+#define NVRAMSTORE_H
+
+#include "Emulator.h"
+#include "BoardProfile.h"
+#include "SpscQueue.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+
+using namespace std;
+
+// This class keeps RAM ranges like the high score and the credits in a file (--nvram),
+// as if the cabinet had battery backed RAM. The saved values are written back once the
+// boot code has initialised the RAM. After that the ranges are compared once per frame,
+// and a changed copy goes through a lock-free queue to a writer thread, so the emulation
+// never waits for the disk. The writer saves at most a few times a second to a temporary
+// file that is renamed over the old one, so a crash never leaves half a file.
+// File format: "NVRM", the size of the data as 16 bit little endian, then the bytes of
+// the ranges in the order of the board profile.
+
+class NvramStore
+{
+    public:
+        NvramStore(const string& filename, const vector<NvramRange>& ranges);
+        virtual ~NvramStore(); // saves the last changes
+
+        void restore(Emulator& emu);      // once, after the boot code
+        void update(const Emulator& emu); // every frame after restore()
+
+    private:
+        static const size_t MAX_SIZE = 256;
+        struct Snapshot {
+            uint16_t size = 0;
+            uint8_t data[MAX_SIZE];
+        };
+
+        string filename;
+        vector<NvramRange> ranges;
+        size_t size = 0;         // bytes of all ranges
+
+        // emulation thread
+        Snapshot saved;          // loaded from the file
+        bool loaded = false;
+        Snapshot current;        // last values handed to the writer
+        bool pending = false;    // current didn't fit into the queue yet
+        bool restored = false;
+
+        SpscQueue<Snapshot, 8> queue;
+        atomic<bool> stop{false};
+        thread writer;
+
+        void load();
+        void gather(const Emulator& emu, Snapshot& snapshot) const;
+        void write_loop();
+        void write_file(const Snapshot& snapshot);
+};
+
+#endif // NVRAMSTORE_H
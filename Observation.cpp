@@ -0,0 +1,110 @@
+#include "Observation.h"
+#include <string.h>
+#include <stdexcept>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// brightness of 0 to 4 set pixels out of 2x2
+static const uint8_t LEVELS[5] = {0, 64, 128, 192, 255};
+
+#ifdef __SSE2__
+// byte j of the 16 VRAM lines from line on, lines apart
+static inline __m128i gather(const uint8_t* vram, int line, int lines, int j){
+    const uint8_t* s = vram + 32*line + j;
+    const int d = 32*lines;
+    return _mm_setr_epi8(s[0],    s[d],    s[2*d],  s[3*d],  s[4*d],  s[5*d],  s[6*d],  s[7*d],
+                         s[8*d],  s[9*d],  s[10*d], s[11*d], s[12*d], s[13*d], s[14*d], s[15*d]);
+}
+
+// 0xFF in every byte that has bit set
+static inline __m128i test_bit(__m128i v, int bit){
+    const __m128i mask = _mm_set1_epi8((char) (1 << bit));
+    return _mm_cmpeq_epi8(_mm_and_si128(v, mask), mask);
+}
+#endif
+
+void Observation::grayscale(VramView vram, uint8_t* out){
+#ifdef __SSE2__
+    // one byte of 16 neighbouring VRAM lines holds 8 rows of 16 screen pixels
+    for(int x=0; x<width; x+=16){
+        for(int j=0; j<32; j++){
+            __m128i v = gather(vram.data, x, 1, j);
+            uint8_t* dst = out + (255 - 8*j)*width + x;
+            for(int b=0; b<8; b++){
+                _mm_storeu_si128((__m128i*)(dst - b*width), test_bit(v, b));
+            }
+        }
+    }
+#else
+    grayscale_scalar(vram, out);
+#endif
+}
+
+void Observation::downsample(VramView vram, uint8_t* out){
+#ifdef __SSE2__
+    // the even and odd VRAM lines are the left and right pixels, bit pairs the two rows.
+    // Averaging the 0/255 masks pairwise gives exactly LEVELS
+    for(int x=0; x<small_width; x+=16){
+        for(int j=0; j<32; j++){
+            __m128i left  = gather(vram.data, 2*x,   2, j);
+            __m128i right = gather(vram.data, 2*x+1, 2, j);
+            for(int k=0; k<4; k++){
+                __m128i bottom = _mm_avg_epu8(test_bit(left, 2*k),   test_bit(right, 2*k));
+                __m128i top    = _mm_avg_epu8(test_bit(left, 2*k+1), test_bit(right, 2*k+1));
+                _mm_storeu_si128((__m128i*)(out + (127 - 4*j - k)*small_width + x), _mm_avg_epu8(top, bottom));
+            }
+        }
+    }
+#else
+    downsample_scalar(vram, out);
+#endif
+}
+
+void Observation::grayscale_scalar(VramView vram, uint8_t* out){
+    for(int y=0; y<height; y++){
+        for(int x=0; x<width; x++){
+            out[y*width + x] = vram.pixel(x, y) ? 255 : 0;
+        }
+    }
+}
+
+void Observation::downsample_scalar(VramView vram, uint8_t* out){
+    for(int y=0; y<small_height; y++){
+        for(int x=0; x<small_width; x++){
+            int count = vram.pixel(2*x, 2*y) + vram.pixel(2*x+1, 2*y) + vram.pixel(2*x, 2*y+1) + vram.pixel(2*x+1, 2*y+1);
+            out[y*small_width + x] = LEVELS[count];
+        }
+    }
+}
+
+Observation::Observation(int depth)
+    : frames(depth)
+{
+    if(depth < 1){
+        throw std::invalid_argument("the history needs at least one frame");
+    }
+    this->ring = make_unique<uint8_t[]>(depth * small_size);
+}
+
+Observation::~Observation()
+{
+}
+
+void Observation::push(VramView vram){
+    downsample(vram, this->ring.get() + this->next * small_size);
+    this->next = (this->next + 1) % this->frames;
+}
+
+const uint8_t* Observation::frame(int age) const{
+    int slot = ((this->next - 1 - age) % this->frames + this->frames) % this->frames;
+    return this->ring.get() + slot * small_size;
+}
+
+void Observation::stacked(uint8_t* out) const{
+    for(int age=this->frames-1; age>=0; age--){
+        memcpy(out, frame(age), small_size);
+        out += small_size;
+    }
+}
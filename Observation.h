@@ -0,0 +1,60 @@
+#ifndef OBSERVATION_H
+#define OBSERVATION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+
+using namespace std;
+
+// read-only view of the 1 bit VRAM at 0x2400, valid as long as the Machine lives.
+// VRAM line x (32 bytes) is screen column x, bit 0 of its first byte is the bottom pixel.
+struct VramView {
+    const uint8_t* data;
+    static const size_t size = 0x1C00;
+
+    // pixel of the rotated 224x256 screen, y = 0 is the top
+    bool pixel(int x, int y) const {
+        int bit = 255 - y;
+        return (this->data[32*x + (bit >> 3)] >> (bit & 7)) & 1;
+    }
+};
+
+// This class converts the VRAM into the compact formats used by batch consumers like
+// agents, instead of the 32 bit RGB of the window:
+// - grayscale: the rotated 224x256 screen, one byte per pixel, 0 or 255
+// - downsample: 112x128, every byte the average of 2x2 pixels (0, 64, 128, 192 or 255)
+// - a history of the last depth downsampled frames that is stacked oldest first
+// With SSE2 16 screen columns are converted at once, the _scalar versions are the
+// reference for them.
+
+class Observation
+{
+    public:
+        static const int width = 224;
+        static const int height = 256;
+        static const int small_width = 112;
+        static const int small_height = 128;
+        static const size_t small_size = small_width * small_height;
+
+        static void grayscale(VramView vram, uint8_t* out);
+        static void downsample(VramView vram, uint8_t* out);
+        static void grayscale_scalar(VramView vram, uint8_t* out);
+        static void downsample_scalar(VramView vram, uint8_t* out);
+
+        // history of downsampled frames
+        Observation(int depth = 4);
+        virtual ~Observation();
+
+        void push(VramView vram);                  // once per frame
+        const uint8_t* frame(int age) const;       // 0 = the newest, no copy
+        void stacked(uint8_t* out) const;          // depth * small_size bytes, the oldest first
+        int depth() const { return this->frames; }
+
+    private:
+        int frames;
+        int next = 0;                // slot of the next push
+        unique_ptr<uint8_t[]> ring;  // frames * small_size, starts black
+};
+
+#endif // OBSERVATION_H
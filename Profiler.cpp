@@ -0,0 +1,128 @@
+#include "Profiler.h"
+#include "Disassembler.h"
+#include <algorithm>
+#include <stdexcept>
+
+static const size_t REPORT_ROUTINES = 40;
+static const size_t REPORT_INSTRUCTIONS = 30;
+
+Profiler::Profiler(Emulator& emu, const SymbolTable& symbols)
+    : emu(emu), symbols(symbols)
+{
+    this->pc_cycles = make_unique<uint64_t[]>(0x10000);
+    this->pc_count  = make_unique<uint64_t[]>(0x10000);
+    this->routines  = make_unique<Routine[]>(0x10000);
+
+    // everything outside of a call counts to the reset routine at 0x0000
+    this->start = this->emu.cycles;
+    this->mark = this->emu.cycles;
+    this->routines[0].calls = 1;
+    this->routines[0].depth = 1;
+    this->frames.push_back({0, 0x10000, this->emu.cycles});
+}
+
+Profiler::~Profiler()
+{
+}
+
+// counts the cycles since the last call or return to the routine on top of the stack
+void Profiler::account(){
+    this->routines[this->frames.back().entry].exclusive += this->emu.cycles - this->mark;
+    this->mark = this->emu.cycles;
+}
+
+void Profiler::pop_frame(){
+    const Frame& frame = this->frames.back();
+    Routine& routine = this->routines[frame.entry];
+    if(--routine.depth == 0){
+        routine.inclusive += this->emu.cycles - frame.start;
+    }
+    this->frames.pop_back();
+}
+
+void Profiler::enter(uint16_t adress){
+    account();
+    int sp = this->emu.sp;
+    // a frame at or below the new return adress was left without RET, e.g. the stack was reset
+    while(this->frames.size() > 1 && this->frames.back().sp <= sp){
+        pop_frame();
+    }
+    Routine& routine = this->routines[adress];
+    routine.calls++;
+    routine.depth++;
+    this->frames.push_back({adress, sp, this->emu.cycles});
+}
+
+void Profiler::leave(){
+    account();
+    int sp = this->emu.sp;
+    // the game may drop return adresses from the stack and return further up
+    while(this->frames.size() > 1 && this->frames.back().sp < sp){
+        pop_frame();
+    }
+    // a RET that doesn't match a call (e.g. a pushed jump adress) leaves no frame
+    if(this->frames.size() > 1 && this->frames.back().sp == sp){
+        pop_frame();
+    }
+}
+
+string Profiler::routine_name(uint16_t entry) const{
+    string name = this->symbols.describe(entry);
+    if(!name.empty()) return name;
+    char text[16];
+    snprintf(text, sizeof(text), "sub_%04x", entry);
+    return text;
+}
+
+void Profiler::report(FILE* out){
+    account();
+    while(!this->frames.empty()){
+        pop_frame();
+    }
+    uint64_t total = max<uint64_t>(this->emu.cycles - this->start, 1);
+
+    vector<int> entries;
+    for(int i=0; i<0x10000; i++){
+        if(this->routines[i].calls > 0) entries.push_back(i);
+    }
+    sort(entries.begin(), entries.end(), [this](int a, int b){
+        return this->routines[a].exclusive > this->routines[b].exclusive;
+    });
+    fprintf(out, "profile of %llu cycles\n\n", (unsigned long long) total);
+    fprintf(out, "%-24s %5s %12s %15s %7s %15s %7s\n", "routine", "entry", "calls", "inclusive", "%", "exclusive", "%");
+    for(size_t i=0; i<entries.size() && i<REPORT_ROUTINES; i++){
+        const Routine& r = this->routines[entries[i]];
+        fprintf(out, "%-24s  %04x %12llu %15llu %6.2f%% %15llu %6.2f%%\n", routine_name(entries[i]).c_str(), entries[i],
+            (unsigned long long) r.calls, (unsigned long long) r.inclusive, 100.0 * r.inclusive / total,
+            (unsigned long long) r.exclusive, 100.0 * r.exclusive / total);
+    }
+
+    vector<int> pcs;
+    for(int i=0; i<0x10000; i++){
+        if(this->pc_count[i] > 0) pcs.push_back(i);
+    }
+    sort(pcs.begin(), pcs.end(), [this](int a, int b){
+        return this->pc_cycles[a] > this->pc_cycles[b];
+    });
+    fprintf(out, "\n%-6s %-24s %-16s %12s %15s %7s\n", "adress", "symbol", "instruction", "executed", "cycles", "%");
+    for(size_t i=0; i<pcs.size() && i<REPORT_INSTRUCTIONS; i++){
+        char text[32];
+        Disassembler::disassemble(this->emu, pcs[i], text, sizeof(text));
+        fprintf(out, "  %04x %-24s %-16s %12llu %15llu %6.2f%%\n", pcs[i], this->symbols.describe(pcs[i]).c_str(), text,
+            (unsigned long long) this->pc_count[pcs[i]], (unsigned long long) this->pc_cycles[pcs[i]],
+            100.0 * this->pc_cycles[pcs[i]] / total);
+    }
+}
+
+void Profiler::save(const string& filename){
+    if(filename == "-"){
+        report(stdout);
+        return;
+    }
+    FILE* fp = fopen(filename.c_str(), "w");
+    if(fp == NULL){
+        throw std::runtime_error("Can not write profile: " + filename);
+    }
+    report(fp);
+    fclose(fp);
+}
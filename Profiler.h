@@ -0,0 +1,66 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "Emulator.h"
+#include "SymbolTable.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <memory>
+
+using namespace std;
+
+// This class measures where the emulated CPU spends its cycles (--profile).
+// Machine samples the cycles of every instruction per PC, and the Emulator reports
+// every CALL, RST, interrupt and RET, from which a shadow call stack gives the
+// inclusive and exclusive cycles of each routine. A routine is named after the
+// symbol at its entry point if a symbol file is loaded.
+// The cycles of a CALL count to the called routine, those of the RET to the caller.
+
+class Profiler
+{
+    public:
+        Profiler(Emulator& emu, const SymbolTable& symbols);
+        virtual ~Profiler();
+
+        void sample(uint16_t pc, uint64_t cycles){
+            this->pc_cycles[pc] += cycles;
+            this->pc_count[pc]++;
+        }
+        void enter(uint16_t adress); // after a call pushed its return adress
+        void leave();                // before a RET pops the return adress
+
+        // the report closes the routines still on the call stack, so it is written once at the end
+        void report(FILE* out);
+        void save(const string& filename); // "-" prints to stdout
+
+    private:
+        struct Routine {
+            uint64_t calls = 0;
+            uint64_t inclusive = 0;
+            uint64_t exclusive = 0;
+            int depth = 0; // activations on the call stack, recursion counts once
+        };
+        struct Frame {
+            uint16_t entry;
+            int sp;         // where the return adress is, a RET with this SP leaves the frame
+            uint64_t start; // cycle count at the call
+        };
+
+        Emulator& emu;
+        const SymbolTable& symbols;
+
+        unique_ptr<uint64_t[]> pc_cycles;
+        unique_ptr<uint64_t[]> pc_count;
+        unique_ptr<Routine[]> routines; // by entry adress
+        vector<Frame> frames;
+        uint64_t start = 0;             // cycle count when profiling started
+        uint64_t mark = 0;              // cycles until here are counted as exclusive
+
+        void account();
+        void pop_frame();
+        string routine_name(uint16_t entry) const;
+};
+
+#endif // PROFILER_H
@@ -0,0 +1,189 @@
+#include "RomLoader.h"
+#include "Checksum.h"
+#include <map>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string.h>
+#include <errno.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+// images that have already been loaded, by board name (and whether the checksums were ignored)
+static map<string, shared_ptr<const RomImage>> cache;
+static mutex cache_mutex;
+
+shared_ptr<const RomImage> RomLoader::load(const BoardProfile& board, bool ignore_crc){
+    lock_guard<mutex> lock(cache_mutex);
+    string key = ignore_crc ? board.name + "/ignore-crc" : board.name;
+    auto cached = cache.find(key);
+    if(cached != cache.end()){
+        return cached->second;
+    }
+
+    auto image = make_shared<RomImage>();
+    image->board = board.name;
+    memset(image->data, 0, sizeof(image->data));
+    string zipname = board.name + ".zip";
+    for(const RomFile& rom : board.roms){
+        uint8_t* dst = image->data + rom.offset;
+        if(!map_file(rom.filename, rom, dst) && !read_from_zip(zipname, rom, dst)){
+            cout << "Please place ROM file in same directory as this executable: " << rom.filename << endl;
+            throw std::runtime_error("ROM File not found at location ./" + rom.filename + " or in ./" + zipname);
+        }
+        verify(rom, dst, ignore_crc);
+    }
+    printf("Sucessfully loaded ROM set %s.\n", board.name.c_str());
+
+    cache[key] = image;
+    return image;
+}
+
+void RomLoader::clear_cache(){
+    lock_guard<mutex> lock(cache_mutex);
+    cache.clear();
+}
+
+bool RomLoader::map_file(const string& filename, const RomFile& rom, uint8_t* dst){
+    int fd = open(filename.c_str(), O_RDONLY);
+    if(fd < 0) return false;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0){
+        int error = errno;
+        close(fd);
+        throw std::runtime_error("Could not read ROM File " + filename + ": " + strerror(error));
+    }
+    if(st.st_size != rom.size){
+        close(fd);
+        // checked before anything is copied, a wrong file can't overflow its place in ROM
+        throw std::runtime_error("ROM File " + filename + " has " + to_string(st.st_size) +
+                                 " bytes, expected " + to_string(rom.size));
+    }
+    void* mapped = mmap(NULL, rom.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapped == MAP_FAILED){
+        throw std::runtime_error("Could not map ROM File " + filename);
+    }
+    memcpy(dst, mapped, rom.size);
+    munmap(mapped, rom.size);
+    return true;
+}
+
+static uint16_t read16(const uint8_t* p){ return p[0] | (p[1] << 8); }
+static uint32_t read32(const uint8_t* p){ return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24); }
+
+bool RomLoader::read_from_zip(const string& zipname, const RomFile& rom, uint8_t* dst){
+    int fd = open(zipname.c_str(), O_RDONLY);
+    if(fd < 0) return false;
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < 22){
+        close(fd);
+        return false;
+    }
+    size_t size = st.st_size;
+    void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapped == MAP_FAILED) return false;
+    const uint8_t* zip = (const uint8_t*) mapped;
+
+    // the end of central directory record is at the end, followed by a comment of up to 64K
+    bool found = false;
+    size_t end = size - 22;
+    size_t stop = (size > 22 + 0xFFFF) ? size - 22 - 0xFFFF : 0;
+    for(;; end--){
+        if(read32(zip+end) == 0x06054b50){
+            found = true;
+            break;
+        }
+        if(end == stop) break;
+    }
+
+    bool loaded = false;
+    if(found && end + 22 <= size){
+        size_t entries = read16(zip+end+10);
+        size_t entry   = read32(zip+end+16); // start of the central directory
+        for(size_t i=0; i<entries && entry+46 <= size; i++){
+            if(read32(zip+entry) != 0x02014b50) break;
+            uint16_t method       = read16(zip+entry+10);
+            uint32_t crc          = read32(zip+entry+16);
+            uint32_t packed_size  = read32(zip+entry+20);
+            uint32_t file_size    = read32(zip+entry+24);
+            uint16_t name_length  = read16(zip+entry+28);
+            uint16_t extra_length = read16(zip+entry+30);
+            uint16_t comment_length = read16(zip+entry+32);
+            uint32_t local_header = read32(zip+entry+42);
+            if(entry + 46 + name_length + extra_length + comment_length > size) break; // truncated
+            string name((const char*) zip+entry+46, name_length);
+            entry += 46 + name_length + extra_length + comment_length;
+
+            if(strcasecmp(name.c_str(), rom.filename.c_str()) != 0) continue;
+            if(file_size != rom.size){
+                munmap(mapped, size);
+                throw std::runtime_error("ROM File " + name + " in " + zipname + " has " + to_string(file_size) +
+                                         " bytes, expected " + to_string(rom.size));
+            }
+            if(method != 0 && method != 8){
+                munmap(mapped, size);
+                throw std::runtime_error("ROM File " + name + " in " + zipname + " uses the unsupported compression method " +
+                                         to_string(method));
+            }
+            if((size_t) local_header + 30 > size) break;
+            size_t data = local_header + 30 + read16(zip+local_header+26) + read16(zip+local_header+28);
+            if(data + packed_size > size) break;
+
+            if(method == 0){ // stored
+                loaded = packed_size == rom.size;
+                if(loaded) memcpy(dst, zip+data, rom.size);
+            } else if(method == 8){ // deflated
+                z_stream stream;
+                memset(&stream, 0, sizeof(stream));
+                stream.next_in   = (Bytef*) (zip+data);
+                stream.avail_in  = packed_size;
+                stream.next_out  = dst;
+                stream.avail_out = rom.size;
+                if(inflateInit2(&stream, -MAX_WBITS) == Z_OK){ // raw deflate without zlib header
+                    loaded = inflate(&stream, Z_FINISH) == Z_STREAM_END && stream.total_out == rom.size;
+                    inflateEnd(&stream);
+                }
+            }
+            if(loaded && crc32(dst, rom.size) != crc){
+                munmap(mapped, size);
+                throw std::runtime_error("ROM File " + name + " in " + zipname + " is damaged");
+            }
+            break;
+        }
+    }
+    munmap(mapped, size);
+    return loaded;
+}
+
+void RomLoader::verify(const RomFile& rom, const uint8_t* data, bool ignore_crc){
+    for(const RomFile& slice : rom.slices){
+        char name[64];
+        snprintf(name, sizeof(name), " at %04x (%s)", slice.offset - rom.offset, slice.filename.c_str());
+        RomFile part = slice;
+        part.filename = rom.filename + name;
+        verify(part, data + (slice.offset - rom.offset), ignore_crc);
+    }
+    bool ok = true;
+    uint32_t crc = crc32(data, rom.size);
+    if(rom.crc32 != 0 && crc != rom.crc32){
+        printf("ROM File %s has CRC32 %08x, expected %08x\n", rom.filename.c_str(), crc, rom.crc32);
+        ok = false;
+    }
+    if(!rom.sha1.empty()){
+        string hash = sha1(data, rom.size);
+        if(hash != rom.sha1){
+            printf("ROM File %s has SHA1 %s, expected %s\n", rom.filename.c_str(), hash.c_str(), rom.sha1.c_str());
+            ok = false;
+        }
+    }
+    if(!ok && !ignore_crc){
+        throw std::runtime_error("ROM File " + rom.filename + " has the wrong checksum (use --ignore-crc to load it anyway)");
+    }
+}
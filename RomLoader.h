@@ -0,0 +1,39 @@
+#ifndef ROMLOADER_H
+#define ROMLOADER_H
+
+#include "BoardProfile.h"
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include <string>
+
+using namespace std;
+
+// The ROM image of a board: all its ROM files at their place in the first 8K of memory
+
+struct RomImage {
+    string board;
+    uint8_t data[0x2000];
+};
+
+// This class loads and verifies the ROM files of a board profile.
+// Files are memory mapped, checked against the size of their place in ROM and their
+// known CRC32/SHA1, and can also be read from a zip archive named after the board
+// (e.g. invaders.zip). Loaded images are kept in a process-wide cache, so that
+// creating another Emulator for the same board does no file I/O at all.
+
+class RomLoader
+{
+    public:
+        // returns the ROM image of the board, throws if a file is missing or wrong
+        static shared_ptr<const RomImage> load(const BoardProfile& board, bool ignore_crc = false);
+        // forget all loaded images, e.g. after the files changed
+        static void clear_cache();
+
+    private:
+        static bool map_file(const string& filename, const RomFile& rom, uint8_t* dst);
+        static bool read_from_zip(const string& zipname, const RomFile& rom, uint8_t* dst);
+        static void verify(const RomFile& rom, const uint8_t* data, bool ignore_crc);
+};
+
+#endif // ROMLOADER_H
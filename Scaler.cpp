@@ -0,0 +1,128 @@
+#include "Scaler.h"
+#include <string.h>
+#include <stdexcept>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// colours of the cellophane strips, as seen on the rotated screen
+static const uint32_t WHITE = 0xFFFFFF;
+static const uint32_t RED   = 0xFF2020;
+static const uint32_t GREEN = 0x20FF20;
+
+#ifndef __SSE2__
+// halve the brightness of every colour channel
+static inline uint32_t darken(uint32_t color){
+    return (color >> 1) & 0x7F7F7F;
+}
+#endif
+
+Scaler::Scaler(int scale, bool scanlines, bool overlay)
+    : scale(scale), scanlines(scanlines), overlay(overlay)
+{
+    if(scale < 1 || scale > 4){
+        throw std::invalid_argument("scale must be between 1 and 4");
+    }
+    this->row = make_unique<uint32_t[]>(224);
+
+    for(int y=0; y<256; y++){
+        this->row_color[y]  = WHITE;
+        this->span_color[y] = WHITE;
+        this->span_begin[y] = 0;
+        this->span_end[y]   = 0;
+        if(!overlay) continue;
+        if(y >= 32 && y < 64){
+            this->row_color[y] = RED;    // strip below the scores (UFO)
+        } else if(y >= 184 && y < 240){
+            this->row_color[y] = GREEN;  // shields and player
+        } else if(y >= 240){
+            this->span_color[y] = GREEN; // remaining lives, the credits stay white
+            this->span_begin[y] = 16;
+            this->span_end[y]   = 134;
+        }
+    }
+}
+
+Scaler::~Scaler()
+{
+    // nothing to delete. Smart pointer deletes row automatically
+}
+
+void Scaler::convert_row(const uint8_t* vram, int y, uint32_t* dst){
+    // the screen is the VRAM rotated 90 degrees counterclockwise:
+    // row y of the screen is bit (255-y) of every 32 byte VRAM line
+    int bit_location = 255 - y;
+    const uint8_t* src = vram + (bit_location >> 3);
+    int b = bit_location & 7;
+
+    uint32_t color = this->row_color[y];
+    for(int x=0; x<224; x++){
+        // -(bit) is all ones if the pixel is set, so no branch is needed
+        dst[x] = (uint32_t) -(int32_t)((src[32*x] >> b) & 1) & color;
+    }
+    uint32_t span = this->span_color[y];
+    for(int x=this->span_begin[y]; x<this->span_end[y]; x++){
+        dst[x] = (uint32_t) -(int32_t)((src[32*x] >> b) & 1) & span;
+    }
+}
+
+void Scaler::scale_row(const uint32_t* src, uint32_t* dst, bool dark){
+#ifdef __SSE2__
+    const __m128i mask = _mm_set1_epi32(0x7F7F7F);
+    for(int x=0; x<224; x+=4){
+        __m128i v = _mm_loadu_si128((const __m128i*)(src+x));
+        if(dark){
+            v = _mm_and_si128(_mm_srli_epi32(v, 1), mask);
+        }
+        switch(this->scale){
+            case 1:
+                _mm_storeu_si128((__m128i*)(dst+x), v);
+                break;
+            case 2: // abcd -> aabb ccdd
+                _mm_storeu_si128((__m128i*)(dst+2*x),   _mm_unpacklo_epi32(v, v));
+                _mm_storeu_si128((__m128i*)(dst+2*x+4), _mm_unpackhi_epi32(v, v));
+                break;
+            case 3: // abcd -> aaab bbcc cddd
+                _mm_storeu_si128((__m128i*)(dst+3*x),   _mm_shuffle_epi32(v, _MM_SHUFFLE(1,0,0,0)));
+                _mm_storeu_si128((__m128i*)(dst+3*x+4), _mm_shuffle_epi32(v, _MM_SHUFFLE(2,2,1,1)));
+                _mm_storeu_si128((__m128i*)(dst+3*x+8), _mm_shuffle_epi32(v, _MM_SHUFFLE(3,3,3,2)));
+                break;
+            case 4: // abcd -> aaaa bbbb cccc dddd
+                _mm_storeu_si128((__m128i*)(dst+4*x),    _mm_shuffle_epi32(v, _MM_SHUFFLE(0,0,0,0)));
+                _mm_storeu_si128((__m128i*)(dst+4*x+4),  _mm_shuffle_epi32(v, _MM_SHUFFLE(1,1,1,1)));
+                _mm_storeu_si128((__m128i*)(dst+4*x+8),  _mm_shuffle_epi32(v, _MM_SHUFFLE(2,2,2,2)));
+                _mm_storeu_si128((__m128i*)(dst+4*x+12), _mm_shuffle_epi32(v, _MM_SHUFFLE(3,3,3,3)));
+                break;
+        }
+    }
+#else
+    int k = this->scale;
+    for(int x=0; x<224; x++){
+        uint32_t color = dark ? darken(src[x]) : src[x];
+        for(int i=0; i<k; i++){
+            dst[k*x+i] = color;
+        }
+    }
+#endif
+}
+
+void Scaler::render(const uint8_t* vram, uint32_t* out, int pitch){
+    int k = this->scale;
+    uint32_t* row = this->row.get();
+    for(int y=0; y<256; y++){
+        convert_row(vram, y, row);
+
+        uint32_t* dst = out + (size_t) y*k*pitch;
+        bool dark_last = this->scanlines && k > 1;
+        scale_row(row, dst, k == 1 && this->scanlines && (y & 1));
+        // the other rows of this pixel row are copies of the first
+        for(int i=1; i<k; i++){
+            if(dark_last && i == k-1){
+                scale_row(row, dst + i*pitch, true);
+            } else {
+                memcpy(dst + i*pitch, dst, this->width()*sizeof(uint32_t));
+            }
+        }
+    }
+}
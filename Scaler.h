@@ -0,0 +1,47 @@
+#ifndef SCALER_H
+#define SCALER_H
+
+#include <stdint.h>
+#include <memory>
+
+using namespace std;
+
+// This class converts the 1 bit VRAM into RGB pixels and scales them up on the CPU,
+// so that the renderer only has to copy the finished image to the window.
+// The optional filters are applied per row while the VRAM is converted:
+// - scanlines darken the last row of every scaled up pixel row (every other row when not scaled)
+// - the colour overlay emulates the coloured cellophane strips on the cabinet's screen
+
+class Scaler
+{
+    public:
+        Scaler(int scale = 1, bool scanlines = false, bool overlay = false);
+        virtual ~Scaler();
+
+        // convert the VRAM (starting at 0x2400) into out, pitch is given in pixels
+        void render(const uint8_t* vram, uint32_t* out, int pitch);
+
+        int width()  const { return 224*this->scale; }
+        int height() const { return 256*this->scale; }
+
+        static const int vram_size = 0x1C00; // 0x2400 - 0x3FFF
+
+    private:
+        int scale;
+        bool scanlines;
+        bool overlay;
+
+        // colour of a set pixel in each (unscaled) row, and the part of the row
+        // from span_begin to span_end that has span_color instead
+        uint32_t row_color[256];
+        uint32_t span_color[256];
+        uint8_t  span_begin[256];
+        uint8_t  span_end[256];
+
+        unique_ptr<uint32_t[]> row; // one converted row before scaling
+
+        void convert_row(const uint8_t* vram, int y, uint32_t* dst);
+        void scale_row(const uint32_t* src, uint32_t* dst, bool darken);
+};
+
+#endif // SCALER_H
@@ -0,0 +1,21 @@
+#include "ShiftRegister.h"
+
+void ShiftRegister::push_and_read(const uint8_t* data, uint8_t* results, size_t n){
+    // the register only holds the last byte between pushes, so each result is two
+    // neighbouring bytes shifted once: no dependency on the previous result
+    uint16_t last = this->value >> 8;
+    int shift = 8 - this->amount;
+    for(size_t i=0; i<n; i++){
+        uint16_t pair = (data[i] << 8) | last;
+        results[i] = (pair >> shift) & 0xFF;
+        last = data[i];
+    }
+    if(n > 0){
+        this->value = (data[n-1] << 8) | (n > 1 ? data[n-2] : this->value >> 8);
+    }
+}
+
+void ShiftRegister::push(const uint8_t* data, size_t n){
+    if(n == 0) return;
+    this->value = (data[n-1] << 8) | (n > 1 ? data[n-2] : this->value >> 8);
+}
@@ -0,0 +1,29 @@
+#ifndef SHIFTREGISTER_H
+#define SHIFTREGISTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// The 16 bit shift register of the Space Invaders board (a MB14241). The CPU can't shift
+// by more than one bit per instruction, so the ROM writes a byte (OUT 4) that pushes the
+// older one into the low half, sets the shift amount (OUT 2) and reads the high byte
+// shifted left by that amount (IN 3). Drawing a sprite at any x position is an OUT 4 and
+// an IN 3 per byte, the batch functions do a whole row of those at once.
+
+class ShiftRegister
+{
+    public:
+        void set_amount(uint8_t amount) { this->amount = amount & 0x07; }
+        void push(uint8_t data) { this->value = (this->value >> 8) | (data << 8); }
+        uint8_t result() const { return (this->value >> (8 - this->amount)) & 0xFF; }
+
+        // push every byte and read the result after each one, like OUT 4; IN 3 n times
+        void push_and_read(const uint8_t* data, uint8_t* results, size_t n);
+        // push the bytes without reading, only the last two matter
+        void push(const uint8_t* data, size_t n);
+
+        uint16_t value = 0;  // the newest byte is the high one
+        uint8_t amount = 0;
+};
+
+#endif // SHIFTREGISTER_H
@@ -0,0 +1,47 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <stddef.h>
+#include <atomic>
+#include <memory>
+
+using namespace std;
+
+// A bounded lock-free queue for exactly one producer thread and one consumer thread.
+// Neither side ever blocks: push() fails when the queue is full and pop() when it is
+// empty. head and tail are on separate cache lines, so the two threads don't slow each
+// other down. Capacity has to be a power of two.
+
+template<typename T, size_t Capacity>
+class SpscQueue
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity-1)) == 0, "capacity has to be a power of two");
+
+    public:
+        SpscQueue() : items(make_unique<T[]>(Capacity)) {}
+
+        // producer thread only
+        bool push(const T& item){
+            size_t tail = this->tail.load(memory_order_relaxed);
+            if(tail - this->head.load(memory_order_acquire) == Capacity) return false;
+            this->items[tail & (Capacity-1)] = item;
+            this->tail.store(tail + 1, memory_order_release);
+            return true;
+        }
+
+        // consumer thread only
+        bool pop(T& item){
+            size_t head = this->head.load(memory_order_relaxed);
+            if(head == this->tail.load(memory_order_acquire)) return false;
+            item = this->items[head & (Capacity-1)];
+            this->head.store(head + 1, memory_order_release);
+            return true;
+        }
+
+    private:
+        unique_ptr<T[]> items;
+        alignas(64) atomic<size_t> head{0}; // next item to pop, written by the consumer
+        alignas(64) atomic<size_t> tail{0}; // next free slot, written by the producer
+};
+
+#endif // SPSCQUEUE_H
@@ -0,0 +1,58 @@
+#include "SymbolTable.h"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <stdio.h>
+
+SymbolTable::SymbolTable()
+{
+}
+
+SymbolTable::~SymbolTable()
+{
+}
+
+void SymbolTable::load(const string& filename){
+    ifstream file(filename);
+    if(!file){
+        throw std::runtime_error("Symbol file not found: " + filename);
+    }
+    string line;
+    int number = 0;
+    while(getline(file, line)){
+        number++;
+        istringstream in(line);
+        string adress, name;
+        if(!(in >> adress) || adress[0] == '#' || adress[0] == ';') continue;
+        in >> name;
+        if(adress[0] == '$') adress.erase(0, 1);
+        if(!adress.empty() && adress.back() == ':') adress.pop_back();
+        size_t end = 0;
+        unsigned long value = 0;
+        try {
+            value = stoul(adress, &end, 16);
+        } catch(const std::logic_error& e){
+            end = 0;
+        }
+        if(name.empty() || end != adress.size() || value > 0xFFFF){
+            throw std::runtime_error(filename + ":" + to_string(number) + ": expected an adress and a name");
+        }
+        this->symbols[value] = name;
+    }
+    printf("Loaded %zu symbols.\n", this->symbols.size());
+}
+
+const string* SymbolTable::find(uint16_t adress) const{
+    auto it = this->symbols.find(adress);
+    return it == this->symbols.end() ? nullptr : &it->second;
+}
+
+string SymbolTable::describe(uint16_t adress) const{
+    auto it = this->symbols.upper_bound(adress);
+    if(it == this->symbols.begin()) return "";
+    --it;
+    if(it->first == adress) return it->second;
+    char offset[8];
+    snprintf(offset, sizeof(offset), "+0x%x", adress - it->first);
+    return it->second + offset;
+}
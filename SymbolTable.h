@@ -0,0 +1,33 @@
+#ifndef SYMBOLTABLE_H
+#define SYMBOLTABLE_H
+
+#include <stdint.h>
+#include <string>
+#include <map>
+
+using namespace std;
+
+// This class maps ROM adresses to routine names, e.g. taken from a commented disassembly.
+// The file has one symbol per line, the hex adress followed by the name:
+//     1A32 BlockCopy
+// The adress may start with $ or 0x and end with a colon, lines starting with # or ; are comments.
+
+class SymbolTable
+{
+    public:
+        SymbolTable();
+        virtual ~SymbolTable();
+
+        void load(const string& filename);
+        bool empty() const { return this->symbols.empty(); }
+
+        // name of the symbol exactly at adress, nullptr if there is none
+        const string* find(uint16_t adress) const;
+        // "Name" or "Name+0x12" for the closest symbol at or below adress, empty if there is none
+        string describe(uint16_t adress) const;
+
+    private:
+        map<uint16_t, string> symbols;
+};
+
+#endif // SYMBOLTABLE_H
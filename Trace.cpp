@@ -0,0 +1,114 @@
+#include "Trace.h"
+#include <chrono>
+#include <stdexcept>
+
+static const auto FLUSH_INTERVAL = std::chrono::milliseconds(100);
+
+static atomic<uint64_t> next_id{1};
+
+static uint64_t steady_ns(){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Trace::Trace(const string& filename)
+{
+    this->fp = fopen(filename.c_str(), "w");
+    if(this->fp == NULL){
+        throw std::runtime_error("Can not write trace file: " + filename);
+    }
+    fprintf(this->fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    this->id = next_id++;
+    this->start = steady_ns();
+    this->flusher = thread(&Trace::flush_loop, this);
+}
+
+Trace::~Trace()
+{
+    {
+        lock_guard<mutex> lock(this->stop_mutex);
+        this->stop = true;
+    }
+    this->stop_signal.notify_one();
+    this->flusher.join();
+
+    uint64_t dropped = 0;
+    for(auto& ring : this->rings){
+        dropped += ring->dropped;
+    }
+    fprintf(this->fp, "\n],\"otherData\":{\"dropped_spans\":%llu}}\n", (unsigned long long) dropped);
+    fclose(this->fp);
+    if(dropped){
+        printf("Trace: %llu spans were dropped, the rings were full\n", (unsigned long long) dropped);
+    }
+}
+
+uint64_t Trace::now() const{
+    return steady_ns() - this->start;
+}
+
+Trace::Ring& Trace::ring(){
+    // the ring of this thread is looked up once per trace
+    thread_local uint64_t cached_id = 0;
+    thread_local Ring* cached = nullptr;
+    if(cached_id != this->id){
+        lock_guard<mutex> lock(this->rings_mutex);
+        this->rings.push_back(make_unique<Ring>());
+        cached = this->rings.back().get();
+        cached->tid = this->rings.size();
+        cached_id = this->id;
+    }
+    return *cached;
+}
+
+void Trace::add(const char* name, const char* category, uint64_t begin, uint64_t end, int64_t frame){
+    Ring& ring = this->ring();
+    if(!ring.events.push({name, category, begin, end, frame})){
+        ring.dropped.store(ring.dropped.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    }
+}
+
+void Trace::name_thread(const char* name){
+    Ring& ring = this->ring();
+    lock_guard<mutex> lock(this->rings_mutex);
+    ring.name = name;
+}
+
+void Trace::flush_loop(){
+    bool stopping = false;
+    while(!stopping){
+        {
+            unique_lock<mutex> lock(this->stop_mutex);
+            stopping = this->stop_signal.wait_for(lock, FLUSH_INTERVAL, [this](){ return this->stop.load(); });
+        }
+        flush();
+    }
+}
+
+void Trace::flush(){
+    lock_guard<mutex> lock(this->rings_mutex);
+    for(auto& ring : this->rings){
+        if(ring->name){
+            // the name of the thread, once
+            fprintf(this->fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                this->first ? "" : ",\n", ring->tid, ring->name);
+            this->first = false;
+            ring->name = nullptr;
+        }
+        Event event;
+        while(ring->events.pop(event)){
+            write_event(*ring, event);
+        }
+    }
+    fflush(this->fp);
+}
+
+void Trace::write_event(const Ring& ring, const Event& event){
+    // complete events ("X") with the times in microseconds
+    fprintf(this->fp, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f",
+        this->first ? "" : ",\n", event.name, event.category, ring.tid, event.begin / 1e3, (event.end - event.begin) / 1e3);
+    if(event.frame >= 0){
+        fprintf(this->fp, ",\"args\":{\"frame\":%lld}", (long long) event.frame);
+    }
+    fprintf(this->fp, "}");
+    this->first = false;
+}
@@ -0,0 +1,87 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "SpscQueue.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+using namespace std;
+
+// This class writes a timeline of what the emulator does (--trace FILE) in the Chrome
+// trace event format, which chrome://tracing and ui.perfetto.dev open: a span for every
+// emulation burst, interrupt, step of updateScreen, sleep and event poll, so a slow frame
+// shows whether emulation or presentation took the time.
+// Every thread that adds spans gets its own ring buffer (a lock-free queue), so adding a
+// span is a few stores and never waits. A flush thread empties the rings every 100 ms and
+// writes the JSON. Spans that don't fit into a full ring are counted as dropped.
+
+class Trace
+{
+    public:
+        Trace(const string& filename);
+        virtual ~Trace(); // writes the remaining spans and closes the file
+
+        uint64_t now() const; // ns since the start of the trace
+        // names and categories have to be string literals, only the pointer is kept
+        void add(const char* name, const char* category, uint64_t begin, uint64_t end, int64_t frame = -1);
+        void name_thread(const char* name); // of the calling thread, shown in the viewer
+
+    private:
+        struct Event {
+            const char* name;
+            const char* category;
+            uint64_t begin;
+            uint64_t end;
+            int64_t frame; // -1 = none
+        };
+        static const size_t RING_SIZE = 65536; // spans, 100 ms of an unpaced --headless run
+        struct Ring {
+            SpscQueue<Event, RING_SIZE> events;
+            uint32_t tid;
+            const char* name = nullptr;
+            atomic<uint64_t> dropped{0};
+        };
+
+        FILE* fp;
+        uint64_t id;     // tells the rings of this trace from those of an earlier one
+        uint64_t start;  // steady clock in ns
+        bool first = true;
+
+        mutex rings_mutex; // only taken when a thread adds its first span, and by the flush
+        vector<unique_ptr<Ring>> rings;
+
+        atomic<bool> stop{false};
+        mutex stop_mutex;
+        condition_variable stop_signal;
+        thread flusher;
+
+        Ring& ring(); // of the calling thread
+        void flush_loop();
+        void flush();
+        void write_event(const Ring& ring, const Event& event);
+};
+
+// adds a span from its construction to the end of the scope, if there is a trace
+class TraceSpan
+{
+    public:
+        TraceSpan(Trace* trace, const char* name, const char* category, int64_t frame = -1)
+            : trace(trace), name(name), category(category), frame(frame), begin(trace ? trace->now() : 0) {}
+        ~TraceSpan() { if(this->trace) this->trace->add(this->name, this->category, this->begin, this->trace->now(), this->frame); }
+
+    private:
+        Trace* trace;
+        const char* name;
+        const char* category;
+        int64_t frame;
+        uint64_t begin;
+};
+
+#endif // TRACE_H
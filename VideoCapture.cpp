@@ -0,0 +1,180 @@
+#include "VideoCapture.h"
+#include <string.h>
+#include <errno.h>
+#include <zlib.h>
+#include <chrono>
+#include <stdexcept>
+
+static bool ends_with(const string& s, const string& end){
+    return s.size() >= end.size() && s.compare(s.size() - end.size(), end.size(), end) == 0;
+}
+
+VideoCapture::VideoCapture(const string& filename, bool overlay)
+    : filename(filename), scaler(1, false, overlay)
+{
+    if(ends_with(filename, ".y4m")){
+        this->format = FORMAT_Y4M;
+    } else if(ends_with(filename, ".rgb") || ends_with(filename, ".raw")){
+        this->format = FORMAT_RAW;
+    } else if(ends_with(filename, ".png")){
+        this->format = FORMAT_PNG;
+    } else {
+        throw std::runtime_error("Unknown capture format, use .y4m, .rgb, .raw or .png: " + filename);
+    }
+    if(this->format != FORMAT_PNG){
+        this->fp = fopen(filename.c_str(), "wb");
+        if(this->fp == NULL){
+            throw std::runtime_error("Can not write capture: " + filename);
+        }
+        if(this->format == FORMAT_Y4M){
+            fprintf(this->fp, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C444\n", width, height);
+        }
+    }
+
+    // everything is allocated here, not per frame
+    this->pool = make_unique<uint8_t[]>(POOL_SIZE * Scaler::vram_size);
+    for(int i=0; i<POOL_SIZE; i++){
+        this->free_buffers.push(i);
+    }
+    this->pixels = make_unique<uint32_t[]>(width * height);
+    this->bytes = make_unique<uint8_t[]>(height * (1 + width*3)); // PNG rows start with a filter byte
+    this->packed_size = compressBound(height * (1 + width*3));
+    this->packed = make_unique<uint8_t[]>(this->packed_size);
+
+    this->writer = thread(&VideoCapture::write_loop, this);
+}
+
+VideoCapture::~VideoCapture()
+{
+    this->stop = true;
+    this->writer.join();
+    if(this->fp && fclose(this->fp) != 0 && !this->failed){
+        fprintf(stderr, "Can not write capture: %s: %s\n", this->filename.c_str(), strerror(errno));
+        this->failed = true;
+    }
+    printf("Captured %llu frames to %s%s.\n", (unsigned long long) this->written, this->filename.c_str(),
+        this->failed ? ", then stopped at an error" : "");
+}
+
+void VideoCapture::add(const uint8_t* vram){
+    int buffer;
+    while(!this->free_buffers.pop(buffer)){
+        this_thread::yield(); // the writer is a whole pool behind
+    }
+    memcpy(this->pool.get() + buffer * Scaler::vram_size, vram, Scaler::vram_size);
+    this->frames.push(buffer); // never full, there are only POOL_SIZE buffers
+}
+
+void VideoCapture::write_loop(){
+    int buffer;
+    bool stopping = false;
+    while(!stopping){
+        stopping = this->stop; // read before draining, so no frame added before stop is missed
+        while(this->frames.pop(buffer)){
+            write_frame(this->pool.get() + buffer * Scaler::vram_size);
+            this->free_buffers.push(buffer);
+        }
+        if(!stopping){
+            this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
+
+void VideoCapture::write_frame(const uint8_t* vram){
+    if(this->failed) return;
+    this->scaler.render(vram, this->pixels.get(), width);
+    bool ok = false;
+    switch(this->format){
+        case FORMAT_Y4M:
+            ok = write_y4m();
+            break;
+        case FORMAT_RAW:{
+            uint8_t* out = this->bytes.get();
+            for(int i=0; i<width*height; i++){
+                uint32_t color = this->pixels[i];
+                *out++ = color >> 16;
+                *out++ = color >> 8;
+                *out++ = color;
+            }
+            ok = fwrite(this->bytes.get(), 1, width*height*3, this->fp) == (size_t) width*height*3;
+            }
+            break;
+        case FORMAT_PNG:
+            ok = write_png();
+            break;
+    }
+    if(!ok){
+        if(this->format != FORMAT_PNG){
+            fprintf(stderr, "Can not write capture: %s: %s\n", this->filename.c_str(), strerror(errno));
+        }
+        this->failed = true;
+        return;
+    }
+    this->written++;
+}
+
+bool VideoCapture::write_y4m(){
+    // BT.601 with studio swing, as players expect it; Y, U and V are planes of full size
+    uint8_t* y = this->bytes.get();
+    uint8_t* u = y + width*height;
+    uint8_t* v = u + width*height;
+    for(int i=0; i<width*height; i++){
+        int r = (this->pixels[i] >> 16) & 0xFF;
+        int g = (this->pixels[i] >> 8) & 0xFF;
+        int b = this->pixels[i] & 0xFF;
+        y[i] = (( 66*r + 129*g +  25*b + 128) >> 8) + 16;
+        u[i] = ((-38*r -  74*g + 112*b + 128) >> 8) + 128;
+        v[i] = ((112*r -  94*g -  18*b + 128) >> 8) + 128;
+    }
+    return fputs("FRAME\n", this->fp) >= 0 && fwrite(this->bytes.get(), 1, width*height*3, this->fp) == (size_t) width*height*3;
+}
+
+// append a PNG chunk: length, type, data and the CRC of type and data
+static bool put_chunk(FILE* fp, const char* type, const uint8_t* data, uint32_t size){
+    uint8_t length[4] = {(uint8_t) (size >> 24), (uint8_t) (size >> 16), (uint8_t) (size >> 8), (uint8_t) size};
+    bool ok = fwrite(length, 1, 4, fp) == 4 && fwrite(type, 1, 4, fp) == 4 && fwrite(data, 1, size, fp) == size;
+    uLong crc = crc32(0, (const Bytef*) type, 4);
+    if(size > 0) crc = crc32(crc, data, size); // crc32() of NULL returns the start value
+    uint8_t check[4] = {(uint8_t) (crc >> 24), (uint8_t) (crc >> 16), (uint8_t) (crc >> 8), (uint8_t) crc};
+    return ok && fwrite(check, 1, 4, fp) == 4;
+}
+
+bool VideoCapture::write_png(){
+    uint8_t* out = this->bytes.get();
+    for(int y=0; y<height; y++){
+        *out++ = 0; // no filter
+        for(int x=0; x<width; x++){
+            uint32_t color = this->pixels[y*width + x];
+            *out++ = color >> 16;
+            *out++ = color >> 8;
+            *out++ = color;
+        }
+    }
+    uLongf size = this->packed_size;
+    // the frames are mostly black, the fastest level compresses them well
+    if(compress2(this->packed.get(), &size, this->bytes.get(), out - this->bytes.get(), 1) != Z_OK){
+        fprintf(stderr, "Can not compress capture frame %llu\n", (unsigned long long) this->written);
+        return false;
+    }
+
+    string name = this->filename.substr(0, this->filename.size() - 4);
+    char number[32];
+    snprintf(number, sizeof(number), "-%06llu.png", (unsigned long long) this->written);
+    name += number;
+    FILE* fp = fopen(name.c_str(), "wb");
+    if(fp == NULL){
+        fprintf(stderr, "Can not write capture: %s: %s\n", name.c_str(), strerror(errno));
+        return false;
+    }
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    // width, height, 8 bit RGB, default compression, filter and no interlacing
+    const uint8_t header[13] = {0, 0, width >> 8, width & 0xFF, 0, 0, height >> 8, height & 0xFF, 8, 2, 0, 0, 0};
+    bool ok = fwrite(signature, 1, 8, fp) == 8 && put_chunk(fp, "IHDR", header, 13) &&
+              put_chunk(fp, "IDAT", this->packed.get(), size) && put_chunk(fp, "IEND", NULL, 0);
+    ok = fclose(fp) == 0 && ok;
+    if(!ok){
+        fprintf(stderr, "Can not write capture: %s: %s\n", name.c_str(), strerror(errno));
+        remove(name.c_str()); // a cut off image
+    }
+    return ok;
+}
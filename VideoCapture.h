@@ -0,0 +1,64 @@
+#ifndef VIDEOCAPTURE_H
+#define VIDEOCAPTURE_H
+
+#include "Scaler.h"
+#include "SpscQueue.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <atomic>
+#include <thread>
+
+using namespace std;
+
+// This class records every emulated frame (--capture), e.g. of a --headless --replay run.
+// The format follows the file name:
+// - .y4m: YUV4MPEG2 video (4:4:4, 60 fps), readable by ffmpeg and most players
+// - .rgb or .raw: 224x256 RGB24 frames one after the other
+// - .png: one PNG file per frame, "shot.png" becomes shot-000000.png, shot-000001.png, ...
+// The emulation thread only copies the 7 KB of 1 bit VRAM into a buffer of a fixed pool
+// and passes its index through a lock-free queue. A writer thread expands the frames
+// with the same colours as the window and writes them. Nothing is dropped: if the writer
+// falls behind by the whole pool, the emulation waits for a free buffer.
+
+class VideoCapture
+{
+    public:
+        VideoCapture(const string& filename, bool overlay);
+        virtual ~VideoCapture(); // writes the remaining frames
+
+        void add(const uint8_t* vram); // the VRAM at 0x2400 after a frame
+
+    private:
+        enum Format { FORMAT_Y4M, FORMAT_RAW, FORMAT_PNG };
+        static const int POOL_SIZE = 32;
+        static const int width = 224;
+        static const int height = 256;
+
+        string filename;
+        Format format;
+        FILE* fp = NULL;              // the video file, PNGs get one file each
+
+        unique_ptr<uint8_t[]> pool;   // POOL_SIZE frames of 1 bit VRAM
+        SpscQueue<int, POOL_SIZE> free_buffers;   // writer -> emulation
+        SpscQueue<int, POOL_SIZE> frames;         // emulation -> writer, in order
+        atomic<bool> stop{false};
+
+        // used only by the writer thread
+        thread writer;
+        Scaler scaler;
+        unique_ptr<uint32_t[]> pixels; // the expanded frame
+        unique_ptr<uint8_t[]> bytes;   // the frame in the file's format
+        unique_ptr<uint8_t[]> packed;  // a compressed PNG image
+        unsigned long packed_size;
+        uint64_t written = 0;
+        bool failed = false;           // a write failed, e.g. the disk is full: nothing more is written
+
+        void write_loop();
+        void write_frame(const uint8_t* vram);
+        // return false if the file couldn't be written
+        bool write_y4m();
+        bool write_png();
+};
+
+#endif // VIDEOCAPTURE_H
@@ -1,21 +1,226 @@
 #include "Machine.h"
+#include "Benchmark.h"
+#include "Diagnostic.h"
+#include "HashLog.h"
 #include <string>
 #include <iostream>
 #include <memory>
+#include <stdexcept>
+#include <climits>
 
 using namespace std;
 
-int main(int argc, char *argv[]){
+static void print_usage(const char* program){
+    printf("Usage: %s [options]\n", program);
+    printf("  --board NAME            board profile of the game (default: invaders or invaders-bin)\n");
+    printf("  --list-boards           list the board profiles and their ROM files\n");
+    printf("  --ignore-crc            load ROM files even if their checksum is wrong\n");
+    printf("  --dip HEX               DIP switch bits of input port 2\n");
+    printf("  --fast-forward          run uncapped until TAB is pressed and released\n");
+    printf("  --fast-forward-frames N run uncapped for the first N frames (e.g. to skip the boot)\n");
+    printf("  --frameskip N           while fast-forwarding draw every Nth frame, 0 = never (default 10)\n");
+    printf("  --scale N               scale the picture 2x, 3x or 4x on the CPU\n");
+    printf("  --scanlines             darken every scaled pixel row's last line\n");
+    printf("  --overlay               coloured overlay like the cellophane strips on the cabinet\n");
+    printf("  --software              use SDL's software renderer, no GPU needed\n");
+    printf("  --record FILE           save the inputs of every frame to FILE at exit\n");
+    printf("  --replay FILE           play back inputs saved with --record\n");
+    printf("  --headless FRAMES       emulate FRAMES frames uncapped without a window and exit\n");
+    printf("  --bench [FILTER]        run the benchmarks (whose name contains FILTER) and exit\n");
+    printf("  --diag PROGRAM...       run 8080 diagnostic programs for CP/M (cpudiag, 8080PRE, 8080EXM) and exit\n");
+    printf("  --diag-engine NAME      also run them on dispatch engine NAME and compare every instruction\n");
+    printf("  --debug                 start in the debugger (debug builds or DEBUGGER=1 only)\n");
+    printf("  --symbols FILE          names of ROM routines (\"1A32 BlockCopy\" per line) for --profile and the debugger\n");
+    printf("  --profile FILE          write the cycles spent per routine and instruction to FILE (- = stdout) at exit\n");
+    printf("  --hash-log FILE         write the state hash of every frame to FILE\n");
+    printf("  --hash-frame N          ... and of every instruction of frame N\n");
+    printf("  --bisect LOG LOG        find the first frame and instruction where two hash logs differ and exit\n");
+    printf("  --netplay PLAYER[:PORT] two player game with another process on this host, PLAYER 1 or 2\n");
+    printf("  --capture FILE          record every frame to FILE: .y4m video, .rgb/.raw RGB24 or .png sequence\n");
+    printf("  --nvram FILE            keep the high score and credits in FILE between runs\n");
+    printf("  --no-fusion             run every instruction on its own (to compare)\n");
+    printf("  --metrics FILE          rewrite performance counters in the Prometheus text format to FILE every second\n");
+    printf("  --trace FILE            write a timeline of the frame phases to FILE (Chrome trace event JSON)\n");
+    printf("  --run-ahead N           show the frame N frames ahead to hide the game's input lag (0-8)\n");
+    printf("  --latency-stats         print how long key presses took to reach the screen, by stage, at exit\n");
+    printf("  --pace-stats            print the CPU use and the wake-up jitter of the frame pacing at exit\n");
+    printf("  --no-idle-skip          run loops that wait for an interrupt round by round (to compare)\n");
+    printf("  --hle                   run native versions of hot ROM routines (turbo for batch runs)\n");
+    printf("  --hle-validate          like --hle, but also run the ROM routines and compare the results\n");
+    printf("  --gdb PORT|PATH         serve gdb's remote protocol on a local TCP port or Unix socket\n");
+}
+
+// the value of a numeric option, throws if it isn't a number in [min, max]
+static long long number(const string& option, const string& value, long long min, long long max, int base = 10){
+    size_t end = 0;
+    long long n = 0;
+    try {
+        n = stoll(value, &end, base);
+    } catch(const std::logic_error& e){ // invalid_argument and out_of_range
+        end = 0;
+    }
+    if(end == 0 || end != value.size() || n < min || n > max){
+        throw std::runtime_error(option + " needs a number from " + to_string(min) + " to " + to_string(max) + ", not " + value);
+    }
+    return n;
+}
+
+static int run(int argc, char *argv[]){
     string game_name = "invaders.";
-    unique_ptr<Machine> machine;
+    MachineOptions options;
+    bool board_given = false;
+    bool bench = false;
+    string bench_filter;
+    uint64_t headless_frames = 0;
+    vector<string> diag_programs;
+    string diag_engine;
+
+    for(int i=1; i<argc; i++){
+        string arg = argv[i];
+        bool has_value = i+1 < argc;
+        if(arg == "--board" && has_value){
+            options.board = argv[++i];
+            board_given = true;
+        } else if(arg == "--list-boards"){
+            for(const BoardProfile& board : BoardProfile::all()){
+                printf("%-14s %s\n", board.name.c_str(), board.description.c_str());
+                for(const RomFile& rom : board.roms){
+                    printf("    %-14s at 0x%04x, %5d bytes, CRC32 %08x\n", rom.filename.c_str(), rom.offset, rom.size, rom.crc32);
+                    for(const RomFile& slice : rom.slices){
+                        printf("      %-12s at 0x%04x, %5d bytes, CRC32 %08x\n", slice.filename.c_str(), slice.offset, slice.size, slice.crc32);
+                    }
+                }
+            }
+            return 0;
+        } else if(arg == "--ignore-crc"){
+            options.ignore_crc = true;
+        } else if(arg == "--dip" && has_value){
+            options.dip_switches = number(arg, argv[++i], 0, 0xFF, 16);
+        } else if(arg == "--fast-forward"){
+            options.fast_forward = true;
+        } else if(arg == "--fast-forward-frames" && has_value){
+            options.fast_forward = true;
+            options.fast_forward_frames = number(arg, argv[++i], 0, LLONG_MAX);
+        } else if(arg == "--frameskip" && has_value){
+            options.frameskip = number(arg, argv[++i], 0, INT_MAX);
+        } else if(arg == "--scale" && has_value){
+            options.scale = number(arg, argv[++i], 1, 4);
+        } else if(arg == "--scanlines"){
+            options.scanlines = true;
+        } else if(arg == "--overlay"){
+            options.overlay = true;
+        } else if(arg == "--software"){
+            options.software_renderer = true;
+        } else if(arg == "--record" && has_value){
+            options.record_file = argv[++i];
+        } else if(arg == "--replay" && has_value){
+            options.replay_file = argv[++i];
+        } else if(arg == "--headless" && has_value){
+            options.headless = true;
+            headless_frames = number(arg, argv[++i], 0, LLONG_MAX);
+        } else if(arg == "--diag" && has_value){
+            while(i+1 < argc && argv[i+1][0] != '-'){
+                diag_programs.push_back(argv[++i]);
+            }
+        } else if(arg == "--diag-engine" && has_value){
+            diag_engine = argv[++i];
+        } else if(arg == "--symbols" && has_value){
+            options.symbol_file = argv[++i];
+        } else if(arg == "--profile" && has_value){
+            options.profile_file = argv[++i];
+        } else if(arg == "--hash-log" && has_value){
+            options.hash_log = argv[++i];
+        } else if(arg == "--hash-frame" && has_value){
+            options.hash_frame = number(arg, argv[++i], 0, LLONG_MAX);
+        } else if(arg == "--bisect" && i+2 < argc){
+            string log_a = argv[++i];
+            string log_b = argv[++i];
+            return HashLog::bisect(log_a, log_b);
+        } else if(arg == "--netplay" && has_value){
+            string value = argv[++i];
+            size_t colon = value.find(':');
+            options.netplay_player = number(arg, value.substr(0, colon), 1, 2);
+            if(colon != string::npos) options.netplay_port = number(arg, value.substr(colon+1), 1, 65534);
+        } else if(arg == "--capture" && has_value){
+            options.capture_file = argv[++i];
+        } else if(arg == "--nvram" && has_value){
+            options.nvram_file = argv[++i];
+        } else if(arg == "--no-fusion"){
+            options.fusion = false;
+        } else if(arg == "--metrics" && has_value){
+            options.metrics_file = argv[++i];
+        } else if(arg == "--trace" && has_value){
+            options.trace_file = argv[++i];
+        } else if(arg == "--run-ahead" && has_value){
+            options.run_ahead = number(arg, argv[++i], 0, 8);
+        } else if(arg == "--latency-stats"){
+            options.latency_stats = true;
+        } else if(arg == "--pace-stats"){
+            options.pace_stats = true;
+        } else if(arg == "--no-idle-skip"){
+            options.idle_skip = false;
+        } else if(arg == "--hle"){
+            options.hle = true;
+        } else if(arg == "--hle-validate"){
+            options.hle_validate = true;
+        } else if(arg == "--debug"){
+#ifdef ENABLE_DEBUGGER
+            options.debug = true;
+#else
+            printf("This build has no debugger, build it with make CONFIG=debug or DEBUGGER=1\n");
+            return 1;
+#endif
+        } else if(arg == "--gdb" && has_value){
+#ifdef ENABLE_DEBUGGER
+            options.gdb = argv[++i];
+#else
+            printf("This build has no debugger, build it with make CONFIG=debug or DEBUGGER=1\n");
+            return 1;
+#endif
+        } else if(arg == "--bench"){
+            bench = true;
+            if(has_value && argv[i+1][0] != '-') bench_filter = argv[++i];
+        } else {
+            print_usage(argv[0]);
+            return (arg == "--help" || arg == "-h") ? 0 : 1;
+        }
+    }
 
-    // Does .e file exist?
-    FILE * fp = fopen((game_name+"e").c_str(), "rb");
-    if(fp!=NULL){
-        fclose(fp);
-        machine = make_unique<Machine>(game_name);
+    if(!diag_programs.empty()){
+        Diagnostic diagnostic(diag_programs, "switch", diag_engine);
+        return diagnostic.run();
+    }
+
+    if(!board_given){
+        // Does .e file exist?
+        FILE * fp = fopen((game_name+"e").c_str(), "rb");
+        if(fp!=NULL){
+            fclose(fp);
+            options.board = "invaders";
+        } else {
+            options.board = "invaders-bin";
+        }
+    }
+    if(bench){
+        Benchmark benchmark(bench_filter, options);
+        return benchmark.run();
+    }
+
+    unique_ptr<Machine> machine = make_unique<Machine>(options);
+    if(options.headless){
+        machine->run_frames(headless_frames);
     } else {
-        machine = make_unique<Machine>("invaders.bin");
+        machine->run();
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]){
+    // configuration errors (missing ROM files, invalid options) end the program with a message
+    try {
+        return run(argc, argv);
+    } catch(std::exception& e){
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
     }
-    machine->run();
 }